@@ -3,30 +3,102 @@
 
 #include "gpaddon.h"
 
-#include <vector>
+#include <cstdint>
 #include <pico/mutex.h>
 
 enum ADDON_PROCESS {
     CORE0_INPUT,
     CORE0_USBREPORT,
-    CORE1_LOOP
+    CORE1_LOOP,
+    ADDON_PROCESS_COUNT
 };
 
+#define ADDON_NAME_SIZE 16
+#define MAX_ADDONS_PER_PROCESS 16
+#define MAX_ADDON_TIMINGS 24
+#define MAX_SPLIT_ADDONS 8
+
+// Time a core0 addon gets per call, and the addons of a core0 phase get together per cycle, so the read-to-report
+// time stays bounded whatever addons are enabled. The addons left once a phase is out of time skip that cycle.
+#define ADDON_BUDGET_US 200
+#define ADDON_PHASE_BUDGET_US 300
+
+// The times are wall time, interrupts included, so only an addon over its budget this many calls in a row is
+// suspended. It's tried again after a backoff, which doubles each time its first call back is still over.
+// Slow work belongs in the `acquire()` of a split addon.
+#define ADDON_OVERRUN_LIMIT 8
+#define ADDON_BACKOFF_MIN_US (100 * 1000)
+#define ADDON_BACKOFF_MAX_US (5 * 1000 * 1000)
+
+// Time an addon took per call of `preprocess()` or `process()`, since the last boot into gamepad mode.
+// Kept over `System::reboot()`, so they can be read from Web Config mode (`/api/getAddonTimings`).
+struct AddonTiming {
+    char name[ADDON_NAME_SIZE];
+    uint32_t process; // ADDON_PROCESS
+    uint32_t calls;
+    uint64_t totalUs;
+    uint32_t worstUs;
+    uint32_t overruns;       // calls over ADDON_BUDGET_US (core0 only)
+    uint32_t suspensions;    // times it was suspended for being over budget
+    uint32_t suspended;      // suspended at the last cycle
+    uint32_t deferred;       // cycles skipped because its phase was out of time
+    uint32_t acquireWorstUs; // split addons: longest `acquire()` on core1
+};
+
+// Starts the timings over, and records them for the addons loaded from then on
+void startAddonTimings();
+uint32_t getAddonTimingCount();
+const AddonTiming& getAddonTiming(uint32_t index);
+
 struct AddonBlock {
     GPAddon * ptr;
-    ADDON_PROCESS process;
+    // Bound to the addon's own type when loaded, so the calls skip the vtable
+    void (*preprocess)(GPAddon *);
+    void (*process)(GPAddon *);
+    AddonTiming * timing; // nullptr when not recorded
+    uint32_t budgetUs;    // 0: none (core1)
+    uint8_t overrunStreak;
+    bool suspended;
+    bool retrying;        // first call after a suspension
+    uint32_t resumeUs;    // `time_us_32()` when a suspended addon is tried again
+    uint32_t backoffUs;
+    char name[ADDON_NAME_SIZE];
 };
 
+// Addons run in contiguous tables, one per ADDON_PROCESS, filled as they're loaded at setup,
+// so a phase only walks its own addons and nothing is allocated once they're loaded.
 class AddonManager {
 public:
     AddonManager() {}
     ~AddonManager() {}
-    void LoadAddon(GPAddon*, ADDON_PROCESS);
+
+    // Sets the addon up and keeps it if it's available, otherwise deletes it
+    template <typename T>
+    void LoadAddon(T* addon, ADDON_PROCESS processAt) {
+        if (!addon->available() || counts[processAt] == MAX_ADDONS_PER_PROCESS) {
+            delete addon; // Don't use the memory if we don't have to
+            return;
+        }
+
+        addon->setup();
+        const AddonBlock & block = AddBlock(addon, processAt,
+            [](GPAddon * a) { static_cast<T *>(a)->T::preprocess(); },
+            [](GPAddon * a) { static_cast<T *>(a)->T::process(); });
+        if (addon->isSplit())
+            AddSplit(block, [](GPAddon * a) { static_cast<T *>(a)->T::acquire(); });
+    }
+
     void PreprocessAddons(ADDON_PROCESS);
     void ProcessAddons(ADDON_PROCESS);
-    GPAddon * GetAddon(std::string); // hack for NeoPicoLED
+    // Runs the slow half of every split addon loaded so far, by any manager. Called from the core1 loop.
+    static void AcquireAddons();
+    GPAddon * GetAddon(const char * name); // hack for NeoPicoLED
 private:
-    std::vector<AddonBlock*> addons;    // addons currently loaded
+    AddonBlock & AddBlock(GPAddon *, ADDON_PROCESS, void (*preprocess)(GPAddon *), void (*process)(GPAddon *));
+    static void AddSplit(const AddonBlock &, void (*acquire)(GPAddon *));
+
+    AddonBlock blocks[ADDON_PROCESS_COUNT][MAX_ADDONS_PER_PROCESS];    // addons currently loaded, per process
+    uint8_t counts[ADDON_PROCESS_COUNT] = {};
 };
 
 #endif
@@ -2,6 +2,7 @@
 #define _Analog_H
 
 #include "gpaddon.h"
+#include "seqlock.h"
 
 #include "GamepadEnums.h"
 
@@ -29,9 +30,17 @@ public:
 	virtual void process();     // Analog Process
 	virtual void preprocess() {}
     virtual std::string name() { return AnalogName; }
+	virtual bool isSplit() { return true; }
+	virtual void acquire();     // ADC reads, on core1
 private:
+	struct AnalogSample {
+		uint16_t x;
+		uint16_t y;
+	};
+
 	uint8_t analogAdcPinX;
 	uint8_t analogAdcPinY;
+	Seqlock<AnalogSample> latest;
 };
 
 #endif  // _Analog_H_
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <ADS1219.h>
 
 #include "gpaddon.h"
+#include "seqlock.h"
 
 #include "GamepadEnums.h"
 
@@ -45,9 +46,12 @@ public:
 	virtual void preprocess() {}
 	virtual void process();     // Analog Process
     virtual std::string name() { return I2CAnalog1219Name; }
+	virtual bool isSplit() { return true; }
+	virtual void acquire();     // I2C polls, on core1
 private:
     ADS1219 * ads;
-	ADS_PINS pins;
+	ADS_PINS pins;              // core1's
+	Seqlock<ADS_PINS> latest;
 	int channelHop;
 	uint32_t uIntervalMS;       // ADS1219 Interval
 	uint32_t nextTimer;         // Turbo Timer
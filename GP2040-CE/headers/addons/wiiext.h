@@ -6,6 +6,7 @@
 #include <hardware/i2c.h>
 #include "BoardConfig.h"
 #include "gpaddon.h"
+#include "seqlock.h"
 #include "gamepad.h"
 #include "storagemanager.h"
 #include "WiiExtension.h"
@@ -44,40 +45,50 @@ public:
 	virtual void process();     // WiiExtension Process
 	virtual void preprocess() {}
 	virtual std::string name() { return WiiExtensionName; }
+	virtual bool isSplit() { return true; }
+	virtual void acquire();     // WiiExtension poll, on core1
 private:
+    // What a poll got, handed over from core1
+    struct WiiExtensionSample {
+        int8_t extensionType = WII_EXTENSION_NONE;
+
+        bool buttonC = false;
+        bool buttonZ = false;
+
+        bool buttonA = false;
+        bool buttonB = false;
+        bool buttonX = false;
+        bool buttonY = false;
+        bool buttonL = false;
+        bool buttonZL = false;
+        bool buttonR = false;
+        bool buttonZR = false;
+
+        bool buttonSelect = false;
+        bool buttonStart = false;
+        bool buttonHome = false;
+
+        bool dpadUp     = false;
+        bool dpadDown   = false;
+        bool dpadLeft   = false;
+        bool dpadRight  = false;
+
+        uint16_t triggerLeft  = 0;
+        uint16_t triggerRight = 0;
+        uint16_t whammyBar    = 0;
+
+        uint16_t leftX = 0;
+        uint16_t leftY = 0;
+        uint16_t rightX = 0;
+        uint16_t rightY = 0;
+    };
+
     WiiExtension * wii;
     uint32_t uIntervalMS;
     uint32_t nextTimer;
 
-    bool buttonC = false;
-    bool buttonZ = false;
-
-    bool buttonA = false;
-    bool buttonB = false;
-    bool buttonX = false;
-    bool buttonY = false;
-    bool buttonL = false;
-    bool buttonZL = false;
-    bool buttonR = false;
-    bool buttonZR = false;
-
-    bool buttonSelect = false;
-    bool buttonStart = false;
-    bool buttonHome = false;
-
-    bool dpadUp     = false;
-    bool dpadDown   = false;
-    bool dpadLeft   = false;
-    bool dpadRight  = false;
-
-    uint16_t triggerLeft  = 0;
-    uint16_t triggerRight = 0;
-    uint16_t whammyBar    = 0;
-
-    uint16_t leftX = 0;
-    uint16_t leftY = 0;
-    uint16_t rightX = 0;
-    uint16_t rightY = 0;
+    WiiExtensionSample sample; // core1's
+    Seqlock<WiiExtensionSample> latest;
 
     uint16_t map(uint16_t x, uint16_t in_min, uint16_t in_max, uint16_t out_min, uint16_t out_max);
 };
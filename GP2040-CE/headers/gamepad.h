@@ -14,17 +14,69 @@
 #include "gamepad/descriptors/KeyboardDescriptors.h"
 #include "gamepad/descriptors/PS4Descriptors.h"
 
+#include "gba/KeyFrameDecoder.h"
+#include "gba/LinkRate.h"
+#include "gba/multiboot.h"
+#include "gba/MultiplayLoader.h"
+#include "gba/spi32.h"
+
+#include "seqlock.h"
+
 #include "pico/stdlib.h"
 
 // MUST BE DEFINED FOR MPG
 extern uint32_t getMillis();
 extern uint64_t getMicro();
 
+// 1 kHz polling: one cycle, from the GBA link to the USB report, per USB frame. Set by the build (see `build.sh`).
+#ifndef GAMEPAD_POLL_1KHZ
+#define GAMEPAD_POLL_1KHZ 0
+#endif
+
+#if GAMEPAD_POLL_1KHZ
+#define GAMEPAD_POLL_MS 1
+#define GAMEPAD_POLL_MICRO 1000
+#else
 #define GAMEPAD_POLL_MS 3
 #define GAMEPAD_POLL_MICRO 3000
+#endif
+
+// Core1 acquisition: core1 reads and debounces the GBAs, and core0 only builds and sends the reports.
+// Set by the build (see `build.sh`).
+#ifndef GAMEPAD_CORE1_INPUT
+#define GAMEPAD_CORE1_INPUT 0
+#endif
+
+// How often the GBA link is sampled: every poll, or as fast as the link keeps up when core1 does it
+#if GAMEPAD_CORE1_INPUT && GBA_LINK_MULTI
+#define GBA_LINK_SAMPLE_MICRO 1000 // a Multi-Play transfer takes most of it
+#elif GAMEPAD_CORE1_INPUT
+#define GBA_LINK_SAMPLE_MICRO 250
+#else
+#define GBA_LINK_SAMPLE_MICRO GAMEPAD_POLL_MICRO
+#endif
 
 #define GAMEPAD_FEATURE_REPORT_SIZE 32
 
+// GBAs bridged as gamepads, each with its own HID interface:
+// the Multi-Play clients (`GBA_LINK_MULTI`), otherwise one per link port (`GBA_LINK_PORTS`)
+#if GBA_LINK_MULTI
+#define GBA_LINK_PLAYERS 3
+#else
+#define GBA_LINK_PLAYERS GBA_LINK_PORTS
+#endif
+
+// What a `read()` got from the GBA link
+struct GBAReading
+{
+	uint32_t keys;      // `GBAKey`, before mapping
+	uint64_t frameTime; // when the frame came in, in microseconds since boot
+	uint64_t edgeTime;  // when the GBA saw the keys change to these, from the frame's edge log (0 if it doesn't say)
+	// Link counters for the rate controller, which only core0 drives (`stepGBALink()`)
+	uint32_t frameCount;
+	uint32_t crcErrors;
+};
+
 struct GamepadButtonMapping
 {
 	GamepadButtonMapping(uint8_t p, uint16_t bm) : 
@@ -62,7 +114,7 @@ public:
 			debounceMS(debounceMS)
 			, f1Mask((GAMEPAD_MASK_S1 | GAMEPAD_MASK_S2))
 			, f2Mask((GAMEPAD_MASK_L3 | GAMEPAD_MASK_R3))
-			, debouncer(debounceMS)
+			, debouncer(debounceMS, GBA_LINK_SAMPLE_MICRO)
 			, mpgStorage(storage)
 	{}
 
@@ -71,6 +123,31 @@ public:
 	void read();
 	void save();
 	void debounce();
+
+	// GBA program to upload, set before `setup()`
+	void setGBARom(const gba::MultibootImage& image);
+	// Multi-Play slot (`GBA_LINK_MULTI`) or link port this gamepad reads, set before `setup()`.
+	// On Multi-Play, only the gamepad of slot 0 brings the link up.
+	void setGBAPlayer(uint8_t player) { gbaPlayer = player; }
+	// Brings the GBA link up in the background (multiboot, then the key stream), called from the core0 loop
+	// Returns true on the call the link comes up
+	bool stepGBALink();
+	// When `stepGBALink()` has work to do next, in microseconds since boot (`UINT64_MAX` once the link is up)
+	uint64_t getGBALinkWakeTime() const;
+	// Multiboot failures per stage, for Web Config
+	const gba::MultibootStats& getGBAStats() const;
+	// GBA keys (`GBAKey`) of the latest `read()`, before mapping
+	uint32_t getGBAKeys() const { return gbaReading.keys; }
+	// When the GBA frame of the latest `read()` came in, in microseconds since boot
+	uint64_t getGBAFrameTime() const { return gbaReading.frameTime; }
+	// The whole of the latest `read()`
+	const GBAReading& getGBAReading() const { return gbaReading; }
+
+	// Core1 acquisition (`GAMEPAD_CORE1_INPUT`): `read()` takes the latest sample core1 published, already debounced.
+	// Called from core1, samples every gamepad set up so far every `GBA_LINK_SAMPLE_MICRO`, on a timer of its own.
+	static void startAcquisition();
+	// Waits for a sample core1 takes after the call
+	void waitForInput();
 	
 	GamepadHotkey hotkey();
 
@@ -167,6 +244,8 @@ private:
 	void releaseAllKeys(void);
 	void pressKey(uint8_t code);
 	uint8_t getModifier(uint8_t code);
+	// Reads the GBA keys into `out`, and returns them as they came
+	GBAReading readGBA(GamepadState& out);
 
 	GamepadHotkeyEntry hotkeyF1Up;
 	GamepadHotkeyEntry hotkeyF1Down;
@@ -176,6 +255,34 @@ private:
 	GamepadHotkeyEntry hotkeyF2Down;
 	GamepadHotkeyEntry hotkeyF2Left;
 	GamepadHotkeyEntry hotkeyF2Right;
+
+	gba::KeyFrameDecoder gbaDecoder;
+	gba::LinkRateController gbaLinkRate;
+#if GBA_LINK_MULTI
+	gba::MultiplayLoader gbaLoader;
+#else
+	gba::MultibootLoader gbaLoader;
+#endif
+	gba::MultibootImage gbaImage = {};
+	gba::Spi32Link* gbaLink = nullptr;
+	uint8_t gbaPlayer = 0;
+	volatile bool gbaLinkLive = false;
+	GBAReading gbaReading = {};
+
+#if GAMEPAD_CORE1_INPUT
+	struct InputSample
+	{
+		GamepadState state;
+		GBAReading gba;
+	};
+
+	// Reads, debounces and publishes a sample, on core1
+	void acquire();
+	static bool onAcquisitionTimer(repeating_timer_t *);
+
+	Seqlock<InputSample> input;
+	GamepadState acquiredState; // core1's own
+#endif
 };
 
 #endif
@@ -9,19 +9,30 @@
 #include <stdint.h>
 #include "GamepadState.h"
 
-// Implement this wrapper function for your platform
-// TODO: Make this a pure virtual member instead.
-uint32_t getMillis();
+// Eager debouncing: a press goes out on the first sample, and only releases wait. Set by the build (see `build.sh`).
+#ifndef GAMEPAD_DEBOUNCE_EAGER
+#define GAMEPAD_DEBOUNCE_EAGER 1
+#endif
 
+// Debounces the 4 dpad and 14 button inputs all at once, as the bits of one word (dpad in the low 4 bits).
+// Each input has a vertical counter (bit i of its count in `counts[i]`) of the samples in a row that differ
+// from its debounced state, and the state follows once the count reaches the samples `debounceMS` spans
+// when `debounce()` is called every `sampleUs`.
 class GamepadDebouncer
 {
 	public:
-		GamepadDebouncer(const uint8_t debounceMS = 5) : debounceMS(debounceMS) { }
+		GamepadDebouncer(const uint8_t debounceMS = 5, const uint32_t sampleUs = 1000, const bool eager = GAMEPAD_DEBOUNCE_EAGER);
 
 		void debounce(GamepadState *state);
 
 		const uint8_t debounceMS;
-		GamepadState debounceState;
-		uint32_t dpadTime[4];
-		uint32_t buttonTime[GAMEPAD_BUTTON_COUNT];
+		const bool eager;
+
+	private:
+		// Up to 31 samples: 7 ms at 250 µs, 93 ms at the 3 ms poll
+		static const uint32_t COUNT_BITS = 5;
+
+		uint32_t threshold; // samples
+		uint32_t debounced = 0;
+		uint32_t counts[COUNT_BITS] = {};
 };
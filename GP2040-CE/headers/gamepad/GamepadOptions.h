@@ -50,5 +50,7 @@ struct GamepadOptions
 	GamepadHotkeyEntry hotkeyF2Left;
 	GamepadHotkeyEntry hotkeyF2Right;
 
+	uint8_t gbaRom; // GBA library entry to upload (see `gba/GBALibrary.h`)
+
 	uint32_t checksum;
 };
@@ -0,0 +1,106 @@
+/*
+ * SPDX-License-Identifier: CC0-1.0
+ *
+ * 32-bit key frame sent by the GBA program, shared with `LinkSPI_demo`.
+ *
+ *  bits  0- 9 : current keys (`GBAKey`)
+ *  bits 10-17 : newest key edge since the previous frame
+ *  bits 18-25 : the edge before it
+ *  bits 26-27 : sequence number, +1 for every frame the GBA sends
+ *  bits 28-31 : CRC-4 of bits 0-27
+ *
+ * Each edge is a byte: bits 0-3 hold the key bit index + 1 (0 means no edge),
+ * bits 4-7 hold how long ago it happened, in ticks of `GBA_FRAME_TICK_LINES` scanlines (saturated).
+ * Edges older than the two newest ones are dropped.
+ *
+ * The CRC is x^4 + x + 1 seeded with 0xF, so that a link stuck at 0 or 1 doesn't pass.
+ *
+ * Multi-Play mode (`GBA_LINK_MULTI`) only carries 16 bits per GBA, so its frame drops the edges:
+ *
+ *  bits  0- 9 : current keys (`GBAKey`)
+ *  bits 10-11 : sequence number
+ *  bits 12-15 : CRC-4 of bits 0-11
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace gba
+{
+
+inline constexpr uint32_t GBA_FRAME_KEYS_MASK = 0x3FF;
+inline constexpr uint32_t GBA_FRAME_EDGE_COUNT = 2;
+inline constexpr uint32_t GBA_FRAME_EDGE_SHIFT = 10;
+inline constexpr uint32_t GBA_FRAME_EDGE_BITS = 8;
+
+inline constexpr uint32_t GBA_FRAME_TICK_LINES = 8;
+inline constexpr uint32_t GBA_FRAME_MAX_TICKS = 15;
+/// One scanline is 1232 cycles at 16.78 MHz
+inline constexpr uint32_t GBA_FRAME_TICK_NS = GBA_FRAME_TICK_LINES * 73433;
+
+constexpr uint32_t packKeyEdge(uint32_t keyBit, uint32_t ticks) {
+	return (keyBit + 1) | ((ticks < GBA_FRAME_MAX_TICKS ? ticks : GBA_FRAME_MAX_TICKS) << 4);
+}
+
+/// @param index 0 for the newest edge
+constexpr uint32_t getKeyEdge(uint32_t frame, uint32_t index) {
+	return (frame >> (GBA_FRAME_EDGE_SHIFT + index * GBA_FRAME_EDGE_BITS)) & 0xFF;
+}
+
+inline constexpr uint32_t GBA_FRAME_SEQ_SHIFT = 26;
+inline constexpr uint32_t GBA_FRAME_SEQ_MASK = 0x3;
+inline constexpr uint32_t GBA_FRAME_CRC_SHIFT = 28;
+inline constexpr uint32_t GBA_FRAME_PAYLOAD_MASK = (1u << GBA_FRAME_CRC_SHIFT) - 1;
+
+/// CRC-4 register after shifting in a zero nibble
+inline constexpr uint8_t GBA_FRAME_CRC_TABLE[16] = {
+	0x0, 0x3, 0x6, 0x5, 0xC, 0xF, 0xA, 0x9, 0xB, 0x8, 0xD, 0xE, 0x7, 0x4, 0x1, 0x2,
+};
+
+constexpr uint32_t getKeyFrameCrc(uint32_t frame, uint32_t crcShift = GBA_FRAME_CRC_SHIFT) {
+	uint32_t crc = 0xF;
+	for (int shift = crcShift - 4; shift >= 0; shift -= 4)
+		crc = GBA_FRAME_CRC_TABLE[crc ^ ((frame >> shift) & 0xF)];
+	return crc;
+}
+
+/// Adds the sequence number and CRC to the keys and edges in `frame`
+constexpr uint32_t sealKeyFrame(uint32_t frame, uint32_t seq) {
+	frame = (frame & ((1u << GBA_FRAME_SEQ_SHIFT) - 1)) | ((seq & GBA_FRAME_SEQ_MASK) << GBA_FRAME_SEQ_SHIFT);
+	return frame | (getKeyFrameCrc(frame) << GBA_FRAME_CRC_SHIFT);
+}
+
+constexpr bool isKeyFrameValid(uint32_t frame) {
+	return (frame >> GBA_FRAME_CRC_SHIFT) == getKeyFrameCrc(frame & GBA_FRAME_PAYLOAD_MASK);
+}
+
+constexpr uint32_t getKeyFrameSeq(uint32_t frame) {
+	return (frame >> GBA_FRAME_SEQ_SHIFT) & GBA_FRAME_SEQ_MASK;
+}
+
+inline constexpr uint32_t GBA_MULTI_FRAME_SEQ_SHIFT = 10;
+inline constexpr uint32_t GBA_MULTI_FRAME_CRC_SHIFT = 12;
+inline constexpr uint32_t GBA_MULTI_FRAME_PAYLOAD_MASK = (1u << GBA_MULTI_FRAME_CRC_SHIFT) - 1;
+
+constexpr uint32_t sealMultiKeyFrame(uint32_t keys, uint32_t seq) {
+	const uint32_t frame = (keys & GBA_FRAME_KEYS_MASK) | ((seq & GBA_FRAME_SEQ_MASK) << GBA_MULTI_FRAME_SEQ_SHIFT);
+	return frame | (getKeyFrameCrc(frame, GBA_MULTI_FRAME_CRC_SHIFT) << GBA_MULTI_FRAME_CRC_SHIFT);
+}
+
+/// Neither an idle line (0xFFFF, 0x0000) nor a BIOS multiboot answer (`0x720x`) passes
+constexpr bool isMultiKeyFrameValid(uint32_t frame) {
+	return frame <= 0xFFFF &&
+		(frame >> GBA_MULTI_FRAME_CRC_SHIFT) == getKeyFrameCrc(frame & GBA_MULTI_FRAME_PAYLOAD_MASK, GBA_MULTI_FRAME_CRC_SHIFT);
+}
+
+/// Words the RPi Pico sends to ask the program for something else than a key frame.
+/// The answer comes in place of the key frame on the following exchange.
+inline constexpr uint32_t GBA_QUERY_FINGERPRINT = 0xF1A90001; ///< answer: the program's `GBA_ROM_FINGERPRINT` (see `build.sh`)
+inline constexpr uint32_t GBA_QUERY_RESET = 0xF1A90002;       ///< no answer: the program resets the GBA, back to the BIOS multiboot
+
+constexpr bool isKeyEdge(uint32_t edge) { return (edge & 0xF) != 0; }
+constexpr uint32_t getKeyEdgeMask(uint32_t edge) { return 1u << ((edge & 0xF) - 1); }
+constexpr uint32_t getKeyEdgeTicks(uint32_t edge) { return edge >> 4; }
+
+}
@@ -0,0 +1,58 @@
+/*
+ * SPDX-License-Identifier: CC0-1.0
+ *
+ * Library of GBA programs in its own flash region, written by `build.sh` as `gba-library.uf2`.
+ * It's flashed separately from the firmware, so programs can be added or changed
+ * without touching the firmware or its settings.
+ *
+ * The region starts with a `GBALibraryHeader`, followed by the compressed images.
+ * Each image is in the BIOS LZ77 format, padded to 16 bytes, for the loader stub (see `GBALoader.h`).
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "gba/multiboot.h"
+
+namespace gba
+{
+
+inline constexpr uint32_t GBA_LIBRARY_MAGIC = 0x4C414247; // "GBAL"
+/// After the first 1 MiB of flash, up to FlashPROM's `EEPROM_ADDRESS_START` (`build.sh` has the same address)
+inline constexpr uint32_t GBA_LIBRARY_ADDRESS = 0x10100000;
+inline constexpr uint32_t GBA_LIBRARY_END = 0x101FE000;
+inline constexpr uint32_t GBA_LIBRARY_MAX_ENTRIES = 16;
+inline constexpr uint32_t GBA_LIBRARY_NAME_SIZE = 16;
+
+struct GBALibraryEntry
+{
+    char name[GBA_LIBRARY_NAME_SIZE]; ///< not terminated if it takes all 16 characters
+    uint32_t keys;                    ///< `GBAKey`s held when a program comes up to pick this one, 0 for none
+    uint32_t fingerprint;             ///< hash of the program, which it answers to `GBA_QUERY_FINGERPRINT`
+    uint32_t offset;                  ///< of the compressed image, from `GBA_LIBRARY_ADDRESS`
+    uint32_t size;                    ///< of the compressed image
+};
+
+struct GBALibraryHeader
+{
+    uint32_t magic;
+    uint32_t count;
+    GBALibraryEntry entries[GBA_LIBRARY_MAX_ENTRIES];
+};
+
+static_assert(sizeof(GBALibraryEntry) == 32 && sizeof(GBALibraryHeader) == 8 + 32 * GBA_LIBRARY_MAX_ENTRIES,
+    "`build.sh` writes this layout");
+
+/// @return the library in flash, or `nullptr` if none was flashed
+const GBALibraryHeader* getGBALibrary();
+
+/// Points `image` at the compressed program of library entry `index`, in place in flash.
+/// `image.rom` stays the loader stub.
+/// @return false (and `image` unchanged) if there's no such entry
+bool getGBALibraryImage(uint32_t index, MultibootImage& image);
+
+/// @return the index of the entry picked by holding `keys`, or -1 if none
+int32_t findGBALibraryEntry(uint32_t keys);
+
+}
@@ -0,0 +1,29 @@
+/*
+ * SPDX-License-Identifier: CC0-1.0
+ *
+ * Protocol of the loader stub (`LinkSPI_loader`), shared with it.
+ * The RPi Pico sends the stub via multiboot, and then the LZ77-compressed program to it,
+ * which the stub expands over itself with the BIOS and runs.
+ *
+ * Normal mode, 32-bit, the stub is the slave. It answers each exchange with
+ * `GBA_LOADER_MAGIC | words received so far`, so the Pico can tell which words it took.
+ *  word 0     : how many words follow
+ *  words 1... : the compressed program (`gbalzss` format), padded to a whole word
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace gba
+{
+
+inline constexpr uint32_t GBA_LOADER_MAGIC = 0x5A5A0000;
+
+/// The compressed program is received at the end of EWRAM, and expanded from its start
+inline constexpr uint32_t GBA_LOADER_EWRAM = 0x02000000;
+inline constexpr uint32_t GBA_LOADER_EWRAM_END = 0x02040000;
+/// Where the BIOS enters a multiboot program
+inline constexpr uint32_t GBA_LOADER_ENTRY = GBA_LOADER_EWRAM + 0xC0;
+
+}
@@ -0,0 +1,59 @@
+/*
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "gba/GBAKeyFrame.h"
+
+namespace gba
+{
+
+/// Turns the key frames received from the GBA back into one key state per poll.
+/// Key states that only lasted between two frames (e.g. a tap shorter than the poll interval)
+/// are replayed from the frame's edge log, one per poll, in the order they happened.
+/// Frames that fail their CRC are counted and dropped, and the last good state is kept.
+class KeyFrameDecoder
+{
+	public:
+		/// @param frame       newest frame from the link, or `GBA_SPI_ERROR`
+		/// @param frameCount  how many frames the link has received so far, to tell a new frame from a re-read
+		/// @return the `GBAKey` state to report for this poll
+		uint32_t decode(uint32_t frame, uint32_t frameCount);
+
+		/// @return how many frames failed their CRC
+		uint32_t getCrcErrors() const { return crcErrors; }
+		/// @return how many frames the GBA sent that were never decoded (e.g. two frames in one poll)
+		uint32_t getSkippedFrames() const { return skippedFrames; }
+		/// @return how long before the GBA sent the frame just decoded the reported state began,
+		///         in ticks of `GBA_FRAME_TICK_LINES` scanlines, or `NO_TICKS` if it's from an older frame
+		///         or its edge isn't in the log (Multi-Play, saturated age)
+		uint32_t getStateTicks() const { return keysFrameCount == lastFrameCount ? keysTicks : NO_TICKS; }
+
+		static constexpr uint32_t NO_TICKS = UINT32_MAX;
+
+	private:
+		void queue(uint32_t state, uint32_t ticks);
+		uint32_t next();
+
+		static constexpr uint32_t REPLAY_SIZE = 4;
+
+		uint32_t keys = 0; // last reported
+		uint32_t lastFrameCount = 0;
+		uint32_t lastSeq = 0;
+		bool hasSeq = false;
+		uint32_t crcErrors = 0;
+		uint32_t skippedFrames = 0;
+		uint32_t replay[REPLAY_SIZE];
+		// Age of each replayed state, and the frame it came from
+		uint32_t replayTicks[REPLAY_SIZE];
+		uint32_t replayFrameCounts[REPLAY_SIZE];
+		uint32_t keysTicks = NO_TICKS;
+		uint32_t keysFrameCount = 0;
+		uint32_t replayHead = 0;
+		uint32_t replayCount = 0;
+};
+
+}
@@ -0,0 +1,75 @@
+/*
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "pico/time.h"
+
+#include "gba/spi32.h"
+
+namespace gba
+{
+
+/// Link clock rates to pick from, slowest first
+inline constexpr uint32_t GBA_LINK_RATES[] = { 262144, 1000 * 1000, 2097152, 4194304 };
+inline constexpr uint32_t GBA_LINK_RATE_COUNT = sizeof(GBA_LINK_RATES) / sizeof(GBA_LINK_RATES[0]);
+/// `GBA_SPI32_DEFAULT_RATE`, kept when the probe gets no answer
+inline constexpr uint32_t GBA_LINK_DEFAULT_RATE_INDEX = 1;
+
+/// Picks the clock rate of the background stream (see `Spi32Link::startStream`) from the CRC of the key frames.
+/// Shorter cables get the fastest rate that stays clean, and a rate that starts failing at runtime is stepped down.
+/// The probe checks a frame per `step()`, so the caller's loop (and USB with it) keeps running meanwhile.
+class LinkRateController
+{
+	public:
+		enum class Status { PROBING, DONE };
+
+		/// Starts trying each rate from the slowest up on the running stream, to keep the fastest one with no bad frame.
+		/// The controller keeps tuning `link` once the probe is done.
+		/// @param frameUs  time between two frames of the stream
+		void begin(Spi32Link& link, uint32_t frameUs);
+
+		/// Checks the frame that came in since the last call, if any, and moves to the next rate once one is done
+		/// @return `DONE` once the rate is chosen (`getBitrate()`)
+		Status step();
+
+		bool isProbing() const { return probing; }
+
+		/// @return when `step()` has a new frame to check
+		absolute_time_t getWakeTime() const { return wakeTime; }
+
+		/// Call with the latest counters once the probe is done, from the core that runs the stream.
+		/// Calls with the same counters change nothing.
+		/// @param crcErrors   frames that failed their CRC so far (`KeyFrameDecoder::getCrcErrors()`)
+		/// @param frameCount  frames received so far (`Spi32Link::frameCount()`)
+		void update(uint32_t crcErrors, uint32_t frameCount);
+
+		uint32_t getBitrate() const { return GBA_LINK_RATES[rateIndex]; }
+
+	private:
+		void setRate(uint32_t index);
+		void startProbeRate(uint32_t index);
+		void finishProbe();
+
+		Spi32Link* link = nullptr;
+		uint32_t rateIndex = GBA_LINK_DEFAULT_RATE_INDEX;
+		uint32_t windowFrames = 0; // frame count at the start of the error window
+		uint32_t windowErrors = 0; // CRC error count at the start of the error window
+		bool windowStarted = false;
+
+		// Probe
+		bool probing = false;
+		uint32_t frameUs = 0;
+		int32_t bestIndex = -1;    // fastest clean rate so far
+		uint32_t seenFrames = 0;   // frame count at the last check
+		uint32_t skippedFrame = 0; // the frame that was on the wire during the rate change
+		uint32_t goodFrames = 0;
+		uint32_t badFrames = 0;
+		absolute_time_t rateTimeout;
+		absolute_time_t wakeTime;
+};
+
+}
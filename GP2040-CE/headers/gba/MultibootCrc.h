@@ -0,0 +1,47 @@
+/*
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#pragma once
+
+#include <array>
+#include <stdint.h>
+
+namespace gba
+{
+
+/// Multiboot CRC: each word is shifted in LSB first, so it goes a byte at a time through a table.
+/// Normal mode uses poly 0xc37b, Multi-Play mode 0xa1c1.
+template <uint32_t Poly>
+class MultibootCrc
+{
+    public:
+        static uint32_t update(uint32_t crc, uint32_t word) {
+            for (uint32_t b = 0; b < 4; b++)
+            {
+                crc = (crc >> 8) ^ table[(crc ^ word) & 0xFF];
+                word >>= 8;
+            }
+
+            return crc;
+        }
+
+    private:
+        static constexpr std::array<uint16_t, 256> makeTable() {
+            std::array<uint16_t, 256> table{};
+
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t crc = i;
+                for (uint32_t b = 0; b < 8; b++)
+                    crc = (crc >> 1) ^ ((crc & 1) ? Poly : 0);
+                table[i] = crc;
+            }
+
+            return table;
+        }
+
+        static constexpr std::array<uint16_t, 256> table = makeTable();
+};
+
+}
@@ -0,0 +1,78 @@
+/*
+ * SPDX-License-Identifier: CC0-1.0
+ *
+ * Multi-Play multiboot, the way `LinkCableMultiboot` sends a program from a parent GBA.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "pico/time.h"
+
+#include "gba/multiboot.h"
+#include "gba/multiplay.h"
+
+namespace gba
+{
+
+/// Sends the GBA program to every GBA BIOS waiting on the Multi-Play link at once, a few transfers at a time,
+/// so the caller's loop (and USB with it) keeps running during the upload.
+/// GBAs that already run a program are left alone, and it's done once none is waiting.
+/// The upload isn't compressed: the loader stub only speaks Normal mode.
+class MultiplayLoader
+{
+    public:
+        using Status = MultibootLoader::Status;
+
+        void begin(const MultibootImage& image);
+
+        /// Does the next part of the upload, for at most about `GBA_MULTIBOOT_STEP_US`
+        /// @return `RUNNING` once a GBA runs a program and none waits for one
+        Status step();
+
+        /// @return when `step()` has something to do next, e.g. once a wait between stages is over
+        absolute_time_t getWakeTime() const { return wakeTime; }
+
+        const MultibootStats& getStats() const;
+
+    private:
+        enum class Stage { DETECT, CONFIRM, HEADER, CONFIRM_HEADER, RECONFIRM, PALETTE, HANDSHAKE, LENGTH, BODY, CHECKSUM, RUNNING };
+
+        void advance();
+        void wait(uint32_t us);
+        void restart();
+        void fail();
+        void succeed();
+        void rejectHeader();
+        /// @return true if every GBA being sent the program answered `expected` with its client bit
+        bool allAnswered(const uint16_t recv[GBA_MULTI_CLIENTS], uint16_t expected) const;
+        /// @return true if every GBA being sent the program answered `value` as is
+        bool allEqual(const uint16_t recv[GBA_MULTI_CLIENTS], uint16_t value) const;
+
+        MultibootImage image = {};
+
+        Stage stage = Stage::RUNNING;
+        uint32_t index = 0;
+        uint32_t tries = 0;
+        absolute_time_t wakeTime;
+
+        // Failed uploads in a row, for the backoff
+        uint32_t failures = 0;
+        uint32_t headerTries = 0;
+
+        // GBAs being sent the program, and the ones already running one
+        uint16_t clientBits = 0;
+        uint16_t runningBits = 0;
+
+        // Upload
+        uint8_t clientData[GBA_MULTI_CLIENTS];
+        uint8_t handshakeData = 0;
+        uint32_t fsize = 0;
+        uint32_t crc = 0;
+        uint32_t seed = 0;
+        uint32_t finalWord = 0;
+        uint32_t dat = 0;
+};
+
+}
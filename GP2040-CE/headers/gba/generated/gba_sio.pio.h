@@ -0,0 +1,192 @@
+// -------------------------------------------------- //
+// This file is autogenerated by pioasm; do not edit! //
+// -------------------------------------------------- //
+
+#pragma once
+
+#if !PICO_NO_HARDWARE
+#include "hardware/pio.h"
+#endif
+
+// ------- //
+// gba_sio //
+// ------- //
+
+#define gba_sio_wrap_target 0
+#define gba_sio_wrap 8
+
+#define gba_sio_CYCLES_PER_BIT 4
+
+static const uint16_t gba_sio_program_instructions[] = {
+            //     .wrap_target
+    0x90a0, //  0: pull   block           side 1     
+    0x1064, //  1: jmp    !y, 4           side 1     
+    0xb003, //  2: mov    pins, null      side 1     
+    0x3020, //  3: wait   0 pin, 0        side 1     
+    0xf03f, //  4: set    x, 31           side 1     
+    0x6101, //  5: out    pins, 1         side 0 [1] 
+    0x5001, //  6: in     pins, 1         side 1     
+    0x1045, //  7: jmp    x--, 5          side 1     
+    0xb00b, //  8: mov    pins, !null     side 1     
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program gba_sio_program = {
+    .instructions = gba_sio_program_instructions,
+    .length = 9,
+    .origin = -1,
+};
+
+static inline pio_sm_config gba_sio_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + gba_sio_wrap_target, offset + gba_sio_wrap);
+    sm_config_set_sideset(&c, 1, false, false);
+    return c;
+}
+
+#include "hardware/clocks.h"
+static inline void gba_sio_program_init(PIO pio, uint sm, uint offset, uint pin_so, uint pin_si, uint pin_sc, float bitrate) {
+    pio_sm_config c = gba_sio_program_get_default_config(offset);
+    sm_config_set_out_pins(&c, pin_si, 1);
+    sm_config_set_in_pins(&c, pin_so);
+    sm_config_set_sideset_pins(&c, pin_sc);
+    // MSB first; frames are pulled explicitly and pushed automatically after 32 bits
+    sm_config_set_out_shift(&c, false, false, 32);
+    sm_config_set_in_shift(&c, false, true, 32);
+    sm_config_set_clkdiv(&c, clock_get_hz(clk_sys) / (bitrate * gba_sio_CYCLES_PER_BIT));
+    const uint32_t outMask = (1u << pin_sc) | (1u << pin_si);
+    pio_sm_set_pins_with_mask(pio, sm, outMask, outMask);
+    pio_sm_set_pindirs_with_mask(pio, sm, outMask, outMask | (1u << pin_so));
+    pio_gpio_init(pio, pin_so);
+    pio_gpio_init(pio, pin_si);
+    pio_gpio_init(pio, pin_sc);
+    gpio_pull_up(pin_so); // an unplugged GBA reads as `LINK_SPI_NO_DATA`
+    pio_sm_init(pio, sm, offset, &c);
+}
+
+#endif
+
+// ------------- //
+// gba_sio_slave //
+// ------------- //
+
+#define gba_sio_slave_wrap_target 0
+#define gba_sio_slave_wrap 8
+
+#define gba_sio_slave_SC_INDEX 2
+
+static const uint16_t gba_sio_slave_program_instructions[] = {
+            //     .wrap_target
+    0xe05f, //  0: set    y, 31                      
+    0x0fc3, //  1: jmp    pin, 3                [15] 
+    0x0000, //  2: jmp    0                          
+    0x0081, //  3: jmp    y--, 1                     
+    0xe03f, //  4: set    x, 31                      
+    0x2022, //  5: wait   0 pin, 2                   
+    0x20a2, //  6: wait   1 pin, 2                   
+    0x4001, //  7: in     pins, 1                    
+    0x0045, //  8: jmp    x--, 5                     
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program gba_sio_slave_program = {
+    .instructions = gba_sio_slave_program_instructions,
+    .length = 9,
+    .origin = -1,
+};
+
+static inline pio_sm_config gba_sio_slave_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + gba_sio_slave_wrap_target, offset + gba_sio_slave_wrap);
+    return c;
+}
+
+static inline void gba_sio_slave_program_init(PIO pio, uint sm, uint offset, uint pin_so, uint pin_si) {
+    const uint pin_sc = pin_so + gba_sio_slave_SC_INDEX;
+    pio_sm_config c = gba_sio_slave_program_get_default_config(offset);
+    sm_config_set_in_pins(&c, pin_so);
+    sm_config_set_jmp_pin(&c, pin_sc);
+    // MSB first, pushed automatically after 32 bits
+    sm_config_set_in_shift(&c, false, true, 32);
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
+    pio_sm_set_pins_with_mask(pio, sm, 0, 1u << pin_si);
+    pio_sm_set_pindirs_with_mask(pio, sm, 1u << pin_si, (1u << pin_so) | (1u << pin_si) | (1u << pin_sc));
+    pio_gpio_init(pio, pin_so);
+    pio_gpio_init(pio, pin_si);
+    pio_gpio_init(pio, pin_sc);
+    gpio_pull_up(pin_so);
+    gpio_pull_up(pin_sc);
+    pio_sm_init(pio, sm, offset, &c);
+}
+
+#endif
+
+// --------- //
+// gba_multi //
+// --------- //
+
+#define gba_multi_wrap_target 0
+#define gba_multi_wrap 18
+
+#define gba_multi_CYCLES_PER_BIT 8
+
+static const uint16_t gba_multi_program_instructions[] = {
+            //     .wrap_target
+    0x80a0, //  0: pull   block                      
+    0xe005, //  1: set    pins, 5                    
+    0xe787, //  2: set    pindirs, 7             [7] 
+    0xe704, //  3: set    pins, 4                [7] 
+    0xe02f, //  4: set    x, 15                      
+    0x6601, //  5: out    pins, 1                [6] 
+    0x0045, //  6: jmp    x--, 5                     
+    0xe705, //  7: set    pins, 5                [7] 
+    0xe086, //  8: set    pindirs, 6                 
+    0xe001, //  9: set    pins, 1                    
+    0xe042, // 10: set    y, 2                       
+    0x2020, // 11: wait   0 pin, 0                   
+    0xea2f, // 12: set    x, 15                 [10] 
+    0x4601, // 13: in     pins, 1                [6] 
+    0x004d, // 14: jmp    x--, 13                    
+    0x20a0, // 15: wait   1 pin, 0                   
+    0x8020, // 16: push   block                      
+    0x008b, // 17: jmp    y--, 11                    
+    0xe007, // 18: set    pins, 7                    
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program gba_multi_program = {
+    .instructions = gba_multi_program_instructions,
+    .length = 19,
+    .origin = -1,
+};
+
+static inline pio_sm_config gba_multi_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + gba_multi_wrap_target, offset + gba_multi_wrap);
+    return c;
+}
+
+static inline void gba_multi_program_init(PIO pio, uint sm, uint offset, uint pin_sd, float baud) {
+    const uint32_t pinMask = 0b111u << pin_sd;
+    pio_sm_config c = gba_multi_program_get_default_config(offset);
+    sm_config_set_set_pins(&c, pin_sd, 3);
+    sm_config_set_out_pins(&c, pin_sd, 1);
+    sm_config_set_in_pins(&c, pin_sd);
+    // LSB first, both ways; a slot is pushed explicitly after its 16 bits
+    sm_config_set_out_shift(&c, true, false, 32);
+    sm_config_set_in_shift(&c, true, false, 32);
+    sm_config_set_clkdiv(&c, clock_get_hz(clk_sys) / (baud * gba_multi_CYCLES_PER_BIT));
+    // SC and SO idle high, SD is pulled up by every unit
+    pio_sm_set_pins_with_mask(pio, sm, pinMask, pinMask);
+    pio_sm_set_pindirs_with_mask(pio, sm, pinMask & ~(1u << pin_sd), pinMask);
+    for (uint pin = pin_sd; pin < pin_sd + 3; pin++)
+        pio_gpio_init(pio, pin);
+    gpio_pull_up(pin_sd);
+    pio_sm_init(pio, sm, offset, &c);
+}
+
+#endif
+
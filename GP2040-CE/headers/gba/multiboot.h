@@ -9,11 +9,99 @@
 
 #include <cstdint>
 
+#include "pico/time.h"
+
+#include "gba/spi32.h"
+
 namespace gba
 {
 
-/// @return `true`  if ROM is sent
-/// @return `false` if GBA program is already running, and only `Start` is pressed on it
-bool sendGBARom(const uint8_t* romAddr, uint32_t romSize);
+/// Longest a single `MultibootLoader::step()` keeps the caller's loop waiting
+inline constexpr uint32_t GBA_MULTIBOOT_STEP_US = 1000;
+
+/// GBA program embedded in the firmware (see `build.sh`)
+struct MultibootImage
+{
+    const uint8_t* rom;
+    uint32_t romSize;
+    /// Program for the loader stub in `rom` to expand (see `GBALoader.h`), or `nullptr` if `rom` is the program itself
+    const uint8_t* payload;
+    uint32_t payloadSize;
+    /// What the program answers to `GBA_QUERY_FINGERPRINT`, so a matching one already running isn't sent again
+    uint32_t fingerprint;
+};
+
+/// Upload failures per stage, counted since power-up.
+/// They're kept over `System::reboot()`, so they can be read from Web Config mode (`/api/getGBALinkStats`).
+struct MultibootStats
+{
+    uint32_t uploads;      ///< uploads the BIOS took
+    uint32_t headerErrors; ///< BIOS didn't take the header
+    uint32_t seedErrors;   ///< no `0x73` seed token after the header
+    uint32_t bodyErrors;   ///< a ROM word wasn't taken, even after retries
+    uint32_t bodyOffset;   ///< offset of the last one
+    uint32_t crcErrors;    ///< final CRC didn't match, or never came
+    uint32_t loaderErrors; ///< loader stub didn't take the compressed program
+};
+
+/// The counters, shared by both loaders (see `MultiplayLoader.h`)
+MultibootStats& getMultibootStats();
+
+/// Sends the GBA program to the GBA BIOS a few words at a time, so the caller's loop
+/// (and USB with it) keeps running during the upload.
+/// It keeps looking for the GBA until it runs the program. A failed stage is retried from the
+/// nearest point the BIOS can resume from, and failed uploads start over, backing off exponentially.
+class MultibootLoader
+{
+    public:
+        enum class Status { BUSY, RUNNING };
+
+        /// Starts looking for the GBA on `link`, which the loader drives until the GBA runs the program
+        void begin(const MultibootImage& image, Spi32Link& link);
+
+        /// Does the next part of the upload, for at most about `GBA_MULTIBOOT_STEP_US`
+        /// @return `RUNNING` once the GBA runs the program, whether it was just uploaded or already running
+        Status step();
+
+        /// @return when `step()` has something to do next, e.g. once a wait between stages is over
+        absolute_time_t getWakeTime() const { return wakeTime; }
+
+        const MultibootStats& getStats() const;
+
+    private:
+        enum class Stage { LISTEN, DETECT, QUERY, RESET, HEADER, HANDSHAKE, BODY, CHECKSUM, PAYLOAD, RUNNING };
+
+        void advance();
+        void wait(uint32_t us);
+        void restart();
+        void fail();
+        void succeed();
+
+        MultibootImage image = {};
+        Spi32Link* link = nullptr;
+
+        Stage stage = Stage::RUNNING;
+        uint32_t index = 0;
+        uint32_t tries = 0;
+        absolute_time_t wakeTime;
+
+        // Failed uploads in a row, for the backoff
+        uint32_t failures = 0;
+        uint32_t headerTries = 0;
+
+        // Running program detection
+        bool hasFrame = false;
+
+        // Upload
+        uint32_t fsize = 0;
+        uint32_t crcA = 0;
+        uint32_t crcB = 0;
+        uint32_t crcC = 0;
+        uint32_t seed = 0;
+        uint32_t gapUs = 0;
+        uint32_t dat = 0;
+        uint32_t next = 0;
+        bool resend = false;
+};
 
 }
@@ -0,0 +1,61 @@
+/*
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/// Multi-Play mode: up to `GBA_MULTI_CLIENTS` GBAs share the link, the RPi Pico being the parent.
+/// Each GBA shows up as its own gamepad. Set by the build (see `build.sh`), and must match the GBA ROM.
+#ifndef GBA_LINK_MULTI
+#define GBA_LINK_MULTI 0
+#endif
+
+namespace gba
+{
+
+/// The RPi Pico takes slot 0, so there's room for 3 GBAs
+inline constexpr uint32_t GBA_MULTI_CLIENTS = 3;
+/// Read from a slot without a GBA (`LINK_CABLE_DISCONNECTED` on the GBA side)
+inline constexpr uint16_t GBA_MULTI_NO_DATA = 0xFFFF;
+/// Fastest Multi-Play rate (`LinkCable::BaudRate::BAUD_RATE_3`)
+inline constexpr uint32_t GBA_MULTI_BAUD = 115200;
+
+/// One unit's turn on SD: a bit of idle, start bit, 16 data bits, stop bit, and a bit for the hand-over
+inline constexpr uint32_t GBA_MULTI_SLOT_US = 20 * 1000000 / GBA_MULTI_BAUD;
+/// On top of that, before a slot counts as empty
+inline constexpr uint32_t GBA_MULTI_SLACK_US = 100;
+/// Whole transfer, with every slot taken
+inline constexpr uint32_t GBA_MULTI_TRANSFER_US = (GBA_MULTI_CLIENTS + 1) * GBA_MULTI_SLOT_US + GBA_MULTI_SLACK_US;
+
+/// Client bit of each slot, which the BIOS answers multiboot commands with
+inline constexpr uint16_t GBA_MULTI_CLIENT_IDS[GBA_MULTI_CLIENTS] = { 0b0010, 0b0100, 0b1000 };
+
+/// Sets up the PIO Multi-Play parent on SD (GP17, a wire the Normal-mode link doesn't use), SC and SI
+void initMulti();
+void deinitMulti();
+
+/// Sends `val` to every GBA, and waits for what each one sends back in the same transfer.
+/// Slots without a GBA are only waited for about as long as a GBA would take to answer.
+void multiExchange(uint16_t val, uint16_t recv[GBA_MULTI_CLIENTS]);
+
+/// Runs a transfer every `intervalUs` in the background, and returns once the first one is done.
+void startMultiStream(uint32_t intervalUs);
+void stopMultiStream();
+
+/// Sets the value sent to the GBAs on the following background transfers.
+void setMultiStreamTx(uint16_t val);
+
+/// @param client slot of the GBA, 0 for the first one
+/// @return its word of the newest background transfer, or `GBA_MULTI_NO_DATA`
+uint16_t latestMultiWord(uint32_t client);
+/// @return the same, as a 32-bit key frame for `KeyFrameDecoder` (no edges), or `GBA_SPI_ERROR`
+uint32_t latestMultiKeyFrame(uint32_t client);
+/// @return how many background transfers were done since the stream started, to tell a new one from a re-read
+uint32_t multiFrameCount();
+
+/// @return true if a GBA answers as the BIOS waiting for multiboot (e.g. one plugged in after the others)
+bool isMultiBiosWaiting();
+
+}
@@ -4,16 +4,145 @@
 
 #pragma once
 
-// Pico SPI
-#include "hardware/spi.h"
+// Pico PIO
+#include "hardware/pio.h"
+#include "pico/time.h"
+
+/// Push mode: the GBA ROM is the link master and sends its keys as soon as they change.
+/// Set by the build (see `build.sh`), and must match the GBA ROM.
+#ifndef GBA_LINK_PUSH
+#define GBA_LINK_PUSH 0
+#endif
+
+/// Link ports in use (1 or 2), one GBA each, each one its own gamepad. Set by the build (see `build.sh`).
+#ifndef GBA_LINK_PORTS
+#define GBA_LINK_PORTS 1
+#endif
 
 namespace gba
 {
 
-uint32_t swapByte32(uint32_t val);
+/// Returned by the link when the GBA didn't take part in the exchange (`LINK_SPI_NO_DATA` on the GBA side)
+inline constexpr uint32_t GBA_SPI_ERROR = 0xFFFFFFFFu;
+
+/// GBA Normal-mode clock rates (`LinkSPI::Mode::MASTER_256KBPS` / `MASTER_2MBPS`)
+inline constexpr uint32_t GBA_SIO_256KBPS = 262144;
+inline constexpr uint32_t GBA_SIO_2MBPS = 2097152;
+
+/// Rate a link starts at, until `setBitrate()`
+inline constexpr uint32_t GBA_SPI32_DEFAULT_RATE = 1000 * 1000;
+
+/// In push mode the GBA re-sends its keys every frame, so this much silence means it's gone
+inline constexpr uint32_t GBA_PUSH_TIMEOUT_US = 100 * 1000;
+
+/// Background streams: this long without an answer means the GBA is gone.
+/// Its program may skip a few polls (e.g. while redrawing its screen), more of them the shorter the poll interval.
+inline constexpr uint32_t GBA_STREAM_STALE_US = 9 * 1000;
+
+/// Time a 32-bit exchange takes on the wire at `bitrate`, once the GBA is ready for it
+inline constexpr uint32_t spi32ExchangeUs(uint32_t bitrate) {
+	return (32 * 1000000 + bitrate - 1) / bitrate;
+}
+
+/// Pins of a link port. For push mode, SC must be wired 2 pins above SO.
+struct Spi32Pins
+{
+	uint so; ///< GBA SO -> Pico
+	uint sc; ///< Pico -> GBA SC
+	uint si; ///< Pico -> GBA SI
+};
+
+/// Link ports, on the former SPI0 pins, then on the SPI1 ones (see README)
+inline constexpr Spi32Pins GBA_SPI32_PORTS[] = {
+	{ PICO_DEFAULT_SPI_RX_PIN, PICO_DEFAULT_SPI_SCK_PIN, PICO_DEFAULT_SPI_TX_PIN }, // GP16, GP18, GP19
+	{ 12, 14, 15 },
+};
+
+static_assert(GBA_LINK_PORTS >= 1 && GBA_LINK_PORTS <= sizeof(GBA_SPI32_PORTS) / sizeof(GBA_SPI32_PORTS[0]));
+
+/// A GBA on a link port, driven by a PIO state machine on pio1.
+/// Links share their PIO programs, and the background streams of all of them run off the same timer,
+/// so every GBA is sampled in the same poll window.
+/// A link must stay where it is once constructed, as DMA and the interrupts write into it.
+class Spi32Link
+{
+	public:
+		explicit Spi32Link(const Spi32Pins& pins, uint32_t bitrate = GBA_SPI32_DEFAULT_RATE);
+		Spi32Link(const Spi32Link&) = delete;
+		Spi32Link& operator=(const Spi32Link&) = delete;
+
+		/// Sets up the PIO Normal-mode master on the link pins, at the link rate.
+		/// Rates above `GBA_SIO_2MBPS` work too, with short enough wires.
+		void init();
+		void deinit();
+		uint32_t exchange(uint32_t val);
+
+		/// Starts an exchange without waiting for it, so the caller can overlap other work with it.
+		/// `get()` then waits for its answer.
+		void put(uint32_t val);
+		uint32_t get();
+
+		/// Changes the master clock rate, also while the background stream runs, and keeps it for `init()`.
+		/// The frame on the wire at that moment may be garbled.
+		void setBitrate(uint32_t bitrate);
+		uint32_t getBitrate() const { return bitrate; }
+
+		/// Starts exchanging 32-bit frames with the GBA every `intervalUs` in the background, using DMA.
+		/// Streams of other links already running keep their interval, and this one joins their beat.
+		/// Returns once the first frame is received.
+		void startStream(uint32_t intervalUs);
+		void stopStream();
+
+		/// Sets the value sent to the GBA on the following background exchanges.
+		void setStreamTx(uint32_t val);
+
+		/// Starts receiving frames pushed by the GBA (`GBA_LINK_PUSH`), as a slave on the same pins.
+		/// Returns once the first frame is received, or after `timeoutUs`.
+		void startPush(uint32_t timeoutUs = GBA_PUSH_TIMEOUT_US);
+		void stopPush();
+
+		/// @return the newest completed background frame, or `GBA_SPI_ERROR` if the stream isn't running or the GBA went silent
+		uint32_t latestFrame() const;
+		/// @return when the newest frame was received, in microseconds since boot
+		uint64_t latestFrameTime() const;
+		/// @return how many frames were received since the stream started, to tell a new frame from a re-read
+		uint32_t frameCount() const;
+
+	private:
+		static constexpr uint32_t RING_SIZE = 4;
+		// Fewest intervals without an answer before the GBA counts as gone (its frame loop may overrun one)
+		static constexpr uint32_t STALE_INTERVALS = 3;
+
+		static bool onStreamTimer(repeating_timer_t *);
+		static void onStreamDma();
+		static void onPush();
+
+		void setHandshake(bool enabled);
+		/// Points the DMA pair at the next ring slot
+		/// @return the channel mask to start them with
+		uint32_t prepareKick();
+		/// Timestamps the frame in the head slot, and moves on to the next one
+		void completeFrame();
+		bool isStale() const;
+
+		const Spi32Pins pins;
+		uint32_t bitrate;
+		int sm = -1;
+		int pushSm = -1;
+
+		int txChannel = -1;
+		int rxChannel = -1;
+		volatile bool streamActive = false;
+		volatile bool streamPush = false;
+		uint32_t staleIntervals = STALE_INTERVALS;        // `GBA_STREAM_STALE_US` in stream intervals
+		volatile uint32_t streamMisses = STALE_INTERVALS; // intervals the GBA didn't answer in
 
-void initSpi32();
-void deinitSpi32();
-uint32_t spi32(uint32_t val);
+		uint32_t txFrame = 0;
+		uint32_t ring[RING_SIZE];
+		uint64_t times[RING_SIZE];      // receive time of each slot
+		volatile uint32_t head = 0;     // slot the RX channel writes into
+		volatile uint32_t latest = 0;   // newest completed slot
+		volatile uint32_t complete = 0; // number of completed frames
+};
 
 }
@@ -9,6 +9,10 @@
 // GP2040 Classes
 #include "gamepad.h"
 #include "addonmanager.h"
+#include "sofscheduler.h"
+#include "loopwake.h"
+#include "stageprofiler.h"
+#include "latencytracer.h"
 
 #include "pico/types.h"
 
@@ -20,7 +24,15 @@ public:
     void run();             // loop core0
 private:
     uint64_t nextRuntime;
+    SofScheduler sofScheduler;
+#if GAMEPAD_LATENCY_TRACE
+    LatencyTracer latencyTracer;
+#endif
     Gamepad snapshot;
+#if GBA_LINK_PLAYERS > 1
+    // Gamepads of the other GBAs (Multi-Play slots or link ports), the first one being the stored gamepad
+    Gamepad* gbaPlayers[GBA_LINK_PLAYERS - 1];
+#endif
     AddonManager addons;
 
     struct WebConfigHotkey {
@@ -46,6 +58,9 @@ private:
         SET_INPUT_MODE_PS4
     };
     static BootAction getBootAction();
+    static BootAction getGamepadBootAction();
+    static InputMode getBootInputMode(BootAction bootAction, InputMode inputMode);
+    void processGBABootAction(Gamepad* gamepad);
 };
 
 #endif
@@ -13,6 +13,11 @@ public:
 	virtual void process() = 0;
 	virtual void preprocess() = 0;
 	virtual std::string name() = 0;
+
+	// Split addons: `acquire()` is the slow half (I2C, ADC...), which runs on core1 so it doesn't hold up the
+	// core0 cycle, and `process()` only merges the latest result it published (see `Seqlock`)
+	virtual bool isSplit() { return false; }
+	virtual void acquire() {}
 };
 
 #endif
\ No newline at end of file
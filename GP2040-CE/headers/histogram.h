@@ -0,0 +1,73 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <cstdint>
+
+// Distribution of a measure (cycles, microseconds...), with its count, min and max.
+// Buckets go 1 per value below 4, then 4 per power of two, so each spans at most a quarter of its lower bound.
+// 92 buckets cover 24 bits, and values past the last bucket land in it.
+// A plain aggregate, so it can live in uninitialized RAM: `reset()` it first.
+template <uint32_t BUCKETS>
+struct Histogram {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint32_t buckets[BUCKETS];
+
+	void reset() {
+		*this = { 0, UINT32_MAX, 0, {} };
+	}
+
+	void add(uint32_t value) {
+		count++;
+		if (value < min)
+			min = value;
+		if (value > max)
+			max = value;
+
+		const uint32_t bucket = getBucket(value);
+		buckets[bucket < BUCKETS ? bucket : BUCKETS - 1]++;
+	}
+
+	// Largest value that `permille` of the recorded ones reached at most, to the bucket (and never above the max)
+	uint32_t getPercentile(uint32_t permille) const {
+		if (count == 0)
+			return 0;
+
+		// Rank of the value, counted from 1
+		const uint32_t rank = ((uint64_t)count * permille + 999) / 1000;
+		uint32_t seen = 0;
+		for (uint32_t bucket = 0; bucket < BUCKETS - 1; bucket++) {
+			seen += buckets[bucket];
+			if (seen >= rank) {
+				const uint32_t top = getBucketTop(bucket);
+				return top < max ? top : max;
+			}
+		}
+
+		return max;
+	}
+
+	static uint32_t getBucket(uint32_t value) {
+		if (value < 4)
+			return value;
+
+		const uint32_t msb = 31 - __builtin_clz(value);
+		return 4 * (msb - 1) + ((value >> (msb - 2)) & 3);
+	}
+
+	// Largest value that falls in a bucket
+	static uint32_t getBucketTop(uint32_t bucket) {
+		if (bucket < 4)
+			return bucket;
+
+		const uint32_t msb = bucket / 4 + 1;
+		return ((4 + bucket % 4 + 1) << (msb - 2)) - 1;
+	}
+};
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef LATENCYTRACER_H_
+#define LATENCYTRACER_H_
+
+#include <cstdint>
+
+#include "gamepad.h"
+#include "histogram.h"
+
+// Latency tracing: how long GBA key edges take to reach the host, per input mode. Set by the build (see `build.sh`).
+#ifndef GAMEPAD_LATENCY_TRACE
+#define GAMEPAD_LATENCY_TRACE 1
+#endif
+
+// Legs of the way from a key edge on the GBA to the host
+enum class LatencyLeg : uint8_t {
+	LINK,   // the GBA sees the edge, to its frame coming in (only when the frame's edge log dates the edge)
+	PICKUP, // frame in, to `Gamepad::read()` taking it
+	BUILD,  // read, to the report built (hotkeys, add-ons, `process()`)
+	QUEUE,  // report built, to handed to the IN endpoint (which may still hold the one before)
+	HOST,   // handed to the endpoint, to the host taking it (IN transfer done)
+	TOTAL,  // from the edge (from the frame, if the GBA didn't date it) to the host
+	COUNT
+};
+
+// Microseconds, up to 131 ms
+typedef Histogram<64> LatencyHistogram;
+
+// Key edges traced in an input mode, since the last boot into gamepad mode in that input mode.
+// Kept over `System::reboot()`, so they can be read from Web Config mode (`/api/getLatencyStats`).
+struct LatencyStats {
+	uint32_t overlapped; // edges not traced, because the one before was still on its way
+	LatencyHistogram legs[(uint32_t)LatencyLeg::COUNT];
+
+	void reset() {
+		overlapped = 0;
+		for (LatencyHistogram& leg : legs)
+			leg.reset();
+	}
+};
+
+// Input modes with latency stats: the gamepad ones
+static const uint32_t LATENCY_INPUT_MODES = INPUT_MODE_PS4 + 1;
+
+const LatencyStats& getLatencyStats(InputMode mode);
+// Name of a leg for Web Config
+const char * getLatencyLegName(LatencyLeg leg);
+
+// Follows one GBA key edge at a time through the core0 cycle, from the GBA's own timestamp to the IN transfer
+// that takes its report to the host. The transfer is timed from the USB interrupt as the host takes the buffer:
+// the class drivers' transfer-complete callbacks only run from `tud_task()`, up to a cycle later.
+// The first gamepad's report only, which goes out on EP1 IN in every input mode.
+class LatencyTracer {
+public:
+	// Starts the stats over, and hooks the USB interrupt (after `initialize_driver()`)
+	void setup();
+
+	// Call after `Gamepad::read()`
+	void onRead(const GBAReading& reading, uint64_t nowUs);
+	// Call before `send_report()`
+	void onBuilt(uint64_t nowUs);
+	// Call after `send_report()`, with what it returned
+	void onQueued(bool queued, uint64_t nowUs);
+
+private:
+	enum class State : uint8_t { IDLE, READ, BUILT, QUEUED };
+
+	static void onUsbIrq();
+	void complete(uint64_t nowUs);
+
+	volatile State state = State::IDLE;
+	uint32_t lastKeys = 0;
+	bool dated = false; // the GBA dated the edge
+	uint64_t edgeUs = 0;
+	uint64_t frameUs = 0;
+	uint64_t readUs = 0;
+	uint64_t builtUs = 0;
+	uint64_t queuedUs = 0;
+};
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef LOOPWAKE_H_
+#define LOOPWAKE_H_
+
+#include <cstdint>
+
+#include "pico/time.h"
+
+// How the loop of a core woke up, since the last boot into gamepad mode.
+// Kept over `System::reboot()`, so they can be read from Web Config mode (`/api/getPollStats`).
+struct WakeStats {
+	uint32_t deadlines;   // wake-ups at a deadline
+	uint32_t doorbells;   // wake-ups by `ring()` before the deadline
+	uint32_t worstLateUs; // latest wake-up after a deadline
+	uint32_t totalLateUs; // summed over all deadlines, for the average
+};
+
+// Starts the stats of both cores over, and records them from then on
+void startWakeStats();
+const WakeStats& getWakeStats(uint32_t core);
+
+// Puts the loop of a core to sleep (WFE) until its next deadline or a doorbell, instead of spinning on the timer.
+// A hardware alarm wakes it a little ahead of the deadline and it spins the rest of the way, so it runs on time
+// to the microsecond. Interrupts taken in between only wake it long enough to go back to sleep.
+class LoopWake {
+public:
+	// Returns true at `deadlineUs` (at once if already past), or false as soon as `ring()` is called
+	bool sleepUntil(uint64_t deadlineUs);
+
+	// Wakes the loop before its deadline, from the other core or an interrupt
+	void ring();
+
+private:
+	static int64_t onAlarm(alarm_id_t id, void * userData);
+
+	volatile bool rung = false;
+	volatile bool alarmFired = false;
+};
+
+// The loop of each core
+LoopWake& getLoopWake(uint32_t core);
+
+#endif
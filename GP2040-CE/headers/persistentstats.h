@@ -0,0 +1,56 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef PERSISTENTSTATS_H_
+#define PERSISTENTSTATS_H_
+
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+template <typename T, typename = void>
+struct HasStatsReset : std::false_type {};
+
+template <typename T>
+struct HasStatsReset<T, std::void_t<decltype(std::declval<T&>().reset())>> : std::true_type {};
+
+// Starts stats over: their own `reset()` if they have one, each element of an array, zeroes otherwise
+template <typename T>
+void resetStats(T& stats) {
+	if constexpr (std::is_array<T>::value) {
+		for (auto& element : stats)
+			resetStats(element);
+	} else if constexpr (HasStatsReset<T>::value) {
+		stats.reset();
+	} else {
+		stats = T{};
+	}
+}
+
+// Stats kept in RAM the C runtime doesn't clear, so they survive `System::reboot()` and can be read from
+// Web Config mode. After a power cycle it's noise, which `Magic` tells apart.
+// Declare it `__uninitialized_ram`, then `get()` it, or `reset()` it to start over. Once either has run,
+// `stats` can be used as is.
+template <typename T, uint32_t Magic>
+struct PersistentStats {
+	static_assert(std::is_trivially_default_constructible<T>::value); // nothing may write it at startup
+
+	uint32_t magic;
+	T stats;
+
+	T& get() {
+		if (magic != Magic)
+			reset();
+
+		return stats;
+	}
+
+	T& reset() {
+		magic = Magic;
+		resetStats(stats);
+		return stats;
+	}
+};
+
+#endif
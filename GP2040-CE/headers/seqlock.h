@@ -0,0 +1,52 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SEQLOCK_H_
+#define SEQLOCK_H_
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "hardware/sync.h"
+
+// Hands a value from one writer to readers on the other core, without a lock on either side.
+// The writer never waits. A reader copies the value out, and copies it again if a publish overlapped,
+// which can only last as long as one copy. Fine for small, trivially copyable values.
+// The RP2040 cores have no exclusive load/store, so this is built on the sequence number and barriers alone.
+template <typename T>
+class Seqlock {
+	static_assert(std::is_trivially_copyable<T>::value);
+
+public:
+	// Writer side (a single core)
+	void publish(const T& value) {
+		sequence = sequence + 1; // odd: a publish is going on
+		__dmb();
+		memcpy(&data, &value, sizeof(T));
+		__dmb();
+		sequence = sequence + 1;
+	}
+
+	// Reader side: copies the latest published value into `value`
+	void read(T& value) const {
+		uint32_t start;
+		do {
+			while ((start = sequence) & 1)
+				tight_loop_contents();
+			__dmb();
+			memcpy(&value, &data, sizeof(T));
+			__dmb();
+		} while (sequence != start);
+	}
+
+	// Changes on every publish, so a reader can tell whether there's anything new
+	uint32_t getSequence() const { return sequence; }
+
+private:
+	volatile uint32_t sequence = 0;
+	T data {};
+};
+
+#endif
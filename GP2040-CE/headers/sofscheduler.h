@@ -0,0 +1,66 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SOFSCHEDULER_H_
+#define SOFSCHEDULER_H_
+
+#include <cstdint>
+
+// Timing of the gamepad cycles since the last boot into gamepad mode.
+// Kept over `System::reboot()`, so they can be read from Web Config mode (`/api/getPollStats`).
+struct CycleStats {
+	uint32_t periodUs; // poll period
+	uint32_t cycles;
+	uint32_t worstUs;  // longest cycle, from the input read to the last report handed to USB
+	uint32_t overruns; // cycles that took longer than the poll period
+};
+
+const CycleStats& getCycleStats();
+
+// Schedules the core0 gamepad cycle against the USB frame clock instead of a free-running timer.
+// The host polls our IN endpoint once per frame, at a fixed offset after each start-of-frame (SOF).
+// Every report learns whether it made the IN token of the frame it was aimed at, and the aim point is
+// nudged later on a hit and pulled earlier on a miss, so reports get armed a small learned margin before the token.
+// Without SOFs (not mounted, suspended, Web Config) it runs free at the poll period.
+class SofScheduler {
+public:
+	// Hooks the USB SOF interrupt, and starts the cycle stats over
+	void setup(uint32_t periodUs);
+
+	// Call at the start of each cycle
+	void beginCycle(uint64_t nowUs);
+	// Call once the reports are sent, with whether `send_report()` armed a new one
+	void endCycle(uint64_t nowUs, bool armed);
+
+	// When the next cycle should start, so that its report is armed just before the IN token it aims at
+	uint64_t getNextRuntime(uint64_t nowUs) const;
+
+	// Learned arm point, in microseconds after the SOF of the aimed frame (negative: the end of the frame before)
+	int32_t getArmOffset() const { return armOffsetUs; }
+	uint32_t getHits() const { return hits; }
+	uint32_t getMisses() const { return misses; }
+
+private:
+	static void onSof(uint32_t frameCount);
+	bool isLocked(uint64_t nowUs) const;
+
+	uint32_t periodUs = 0;
+	uint64_t cycleStartUs = 0;
+	uint32_t cycleUs = 0; // cycle start to report armed, tracking the slowest recent one
+
+	volatile int32_t armOffsetUs = 0;
+	volatile int32_t stepUs = 0;
+	volatile int32_t lastStep = 0; // direction of the last correction, while `stepUs` is still coarse
+	volatile uint32_t hits = 0;
+	volatile uint32_t misses = 0;
+
+	// Report waiting to be checked at the SOF after the frame it was aimed at
+	volatile bool pending = false;
+	volatile uint32_t pendingFrame = 0;
+
+	volatile uint64_t sofUs = 0;
+	volatile uint32_t sofFrame = 0;
+};
+
+#endif
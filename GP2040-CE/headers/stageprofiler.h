@@ -0,0 +1,63 @@
+/*
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef STAGEPROFILER_H_
+#define STAGEPROFILER_H_
+
+#include <cstdint>
+
+#include "histogram.h"
+
+// Stage profiling: CPU cycles of each stage of the core0 gamepad cycle. Set by the build (see `build.sh`).
+#ifndef GAMEPAD_STAGE_PROFILE
+#define GAMEPAD_STAGE_PROFILE 1
+#endif
+
+// Stages of the core0 gamepad cycle, in the order `GP2040::run()` goes through them
+enum class ProfileStage : uint8_t {
+	READ,
+	DEBOUNCE,
+	HOTKEY,
+	PREPROCESS_ADDONS,
+	PROCESS,
+	PROCESS_ADDONS,
+	SEND_REPORT,
+	RECEIVE_REPORT,
+	TUD_TASK,
+	COUNT
+};
+
+// Cycles a stage took, since the last boot into gamepad mode, up to the 24 bits of the SysTick counter
+// (134 ms at 125 MHz). Kept over `System::reboot()`, so they can be read from Web Config mode (`/api/getStageProfile`).
+typedef Histogram<92> StageProfile;
+
+// Starts the profiles over, and records them from then on
+void startStageProfile();
+const StageProfile& getStageProfile(ProfileStage stage);
+// Name of a stage for Web Config, as the code calls it
+const char * getStageName(ProfileStage stage);
+
+// Measures the stages one after the other on the core0 SysTick: `start()` at the beginning of the first one,
+// then `lap()` at the end of each, which starts the next. `start()` again skips what's in between.
+class StageProfiler {
+public:
+	void start();
+	void lap(ProfileStage stage);
+
+private:
+	uint32_t lastTick = 0;
+};
+
+StageProfiler& getStageProfiler();
+
+// So that `GAMEPAD_STAGE_PROFILE=0` leaves nothing behind in the cycle
+#if GAMEPAD_STAGE_PROFILE
+#define PROFILE_START() getStageProfiler().start()
+#define PROFILE_LAP(stage) getStageProfiler().lap(ProfileStage::stage)
+#else
+#define PROFILE_START()
+#define PROFILE_LAP(stage)
+#endif
+
+#endif
@@ -13,6 +13,7 @@
 #include "enums.h"
 #include "helper.h"
 #include "gamepad.h"
+#include "seqlock.h"
 
 #include "mbedtls/rsa.h"
 
@@ -260,6 +261,12 @@ public:
 	void ClearFeatureData();
 	uint8_t * GetFeatureData();
 
+	// Core0 -> core1 handoff, without a lock: core0 publishes its gamepad state and the feature data once per cycle,
+	// and core1 takes them over into the processed gamepad and `GetProcessedFeatureData()` before running its add-ons
+	void PublishProcessedGamepad(const GamepadState& state);
+	void TakeProcessedGamepad();
+	uint8_t * GetProcessedFeatureData();
+
 	void ResetSettings(); 				// EEPROM Reset Feature
 
 private:
@@ -290,6 +297,12 @@ private:
 	LEDOptions ledOptions;
 	PS4Options ps4Options;
 	uint8_t featureData[32]; // USB X-Input Feature Data
+	struct ProcessedData {
+		GamepadState state;
+		uint8_t featureData[32];
+	};
+	Seqlock<ProcessedData> processedData; // Published by core0
+	uint8_t processedFeatureData[32];     // Core1's copy
 	SplashImage splashImage;
 };
 
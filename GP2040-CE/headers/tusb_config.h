@@ -97,7 +97,7 @@
 //------------- CLASS -------------//
 #define CFG_TUD_CDC               0
 #define CFG_TUD_MSC               0
-#define CFG_TUD_HID               2
+#define CFG_TUD_HID               4
 #define CFG_TUD_MIDI              0
 #define CFG_TUD_VENDOR            0
 #define CFG_TUD_ECM_RNDIS         1
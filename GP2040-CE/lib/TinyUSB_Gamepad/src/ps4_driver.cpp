@@ -4,6 +4,7 @@
  */
 
 #include "ps4_driver.h"
+#include "usb_driver.h"
 
 #include "CRC32.h"
 
@@ -214,4 +215,4 @@ const usbd_class_driver_t ps4_driver =
 		.open = hidd_open,
 		.control_xfer_cb = hidd_control_xfer_cb,
 		.xfer_cb = hidd_xfer_cb,
-		.sof = NULL};
+		.sof = usb_driver_sof_cb};
@@ -21,6 +21,8 @@
 UsbMode usb_mode = USB_MODE_HID;
 InputMode input_mode = INPUT_MODE_XINPUT;
 bool usb_mounted = false;
+uint8_t player_count = 1;
+static volatile sof_callback_t sof_callback = nullptr;
 
 InputMode get_input_mode(void)
 {
@@ -32,12 +34,20 @@ bool get_usb_mounted(void)
 	return usb_mounted;
 }
 
-void initialize_driver(InputMode mode)
+uint8_t get_player_count(void)
+{
+	return player_count;
+}
+
+void initialize_driver(InputMode mode, uint8_t players)
 {
 	input_mode = mode;
 	if (mode == INPUT_MODE_CONFIG)
 		usb_mode = USB_MODE_NET;
 
+	if (mode == INPUT_MODE_HID)
+		player_count = players < CFG_TUD_HID ? players : CFG_TUD_HID;
+
 	tusb_init();
 }
 
@@ -50,16 +60,16 @@ void receive_report(uint8_t *buffer)
 	}
 }
 
-void send_report(void *report, uint16_t report_size)
+bool send_report(void *report, uint16_t report_size)
 {
 	static uint8_t previous_report[CFG_TUD_ENDPOINT0_SIZE] = { };
 
 	if (tud_suspended())
 		tud_remote_wakeup();
 
+	bool sent = false;
 	if (memcmp(previous_report, report, report_size) != 0)
 	{
-		bool sent = false;
 		switch (input_mode)
 		{
 			case INPUT_MODE_XINPUT:
@@ -74,6 +84,46 @@ void send_report(void *report, uint16_t report_size)
 		if (sent)
 			memcpy(previous_report, report, report_size);
 	}
+
+	return sent;
+}
+
+void send_player_report(uint8_t player, void *report, uint16_t report_size)
+{
+	static uint8_t previous_reports[CFG_TUD_HID][CFG_TUD_ENDPOINT0_SIZE] = { };
+
+	if (player == 0 || player >= player_count)
+		return;
+
+	if (memcmp(previous_reports[player], report, report_size) != 0)
+	{
+		if (tud_hid_n_ready(player) && tud_hid_n_report(player, 0, report, report_size))
+			memcpy(previous_reports[player], report, report_size);
+	}
+}
+
+void set_sof_callback(sof_callback_t callback)
+{
+	sof_callback = callback;
+}
+
+void usb_driver_sof_cb(uint8_t rhport, uint32_t frame_count)
+{
+	(void)rhport;
+
+	sof_callback_t callback = sof_callback;
+	if (callback)
+		callback(frame_count);
+}
+
+// The SOF interrupt is off unless a driver asks for it
+static void enable_sof(bool enabled)
+{
+#if TUSB_VERSION_MAJOR == 0 && TUSB_VERSION_MINOR < 16
+	usbd_sof_enable(0, enabled);
+#else
+	usbd_sof_enable(0, SOF_CONSUMER_USER, enabled);
+#endif
 }
 
 /* USB Driver Callback (Required for XInput) */
@@ -170,12 +220,14 @@ void tud_hid_set_report_cb(uint8_t itf, uint8_t report_id, hid_report_type_t rep
 void tud_mount_cb(void)
 {
 	usb_mounted = true;
+	enable_sof(true);
 }
 
 // Invoked when device is unmounted
 void tud_umount_cb(void)
 {
 	usb_mounted = false;
+	enable_sof(false);
 }
 
 // Invoked when usb bus is suspended
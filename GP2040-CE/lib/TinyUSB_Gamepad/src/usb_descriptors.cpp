@@ -76,6 +76,35 @@ uint8_t const *tud_hid_descriptor_report_cb(uint8_t itf)
 	}
 }
 
+// HID mode with several players: the single gamepad interface, repeated once per player,
+// each with its own IN endpoint and the same report descriptor
+#define HID_INTERFACE_DESC_SIZE (sizeof(hid_configuration_descriptor) - 9)
+static uint8_t hid_players_configuration_descriptor[9 + CFG_TUD_HID * HID_INTERFACE_DESC_SIZE];
+
+static uint8_t const *get_hid_configuration_descriptor(void)
+{
+	const uint8_t players = get_player_count();
+	if (players <= 1)
+		return hid_configuration_descriptor;
+
+	uint8_t *desc = hid_players_configuration_descriptor;
+	const uint16_t size = 9 + players * HID_INTERFACE_DESC_SIZE;
+	memcpy(desc, hid_configuration_descriptor, 9);
+	desc[2] = LSB(size); // wTotalLength
+	desc[3] = MSB(size);
+	desc[4] = players;   // bNumInterfaces
+
+	for (uint8_t player = 0; player < players; player++)
+	{
+		uint8_t *itf = desc + 9 + player * HID_INTERFACE_DESC_SIZE;
+		memcpy(itf, hid_configuration_descriptor + 9, HID_INTERFACE_DESC_SIZE);
+		itf[2] = GAMEPAD_INTERFACE + player;                  // bInterfaceNumber
+		itf[9 + 9 + 2] = (GAMEPAD_ENDPOINT + player) | 0x80; // bEndpointAddress
+	}
+
+	return desc;
+}
+
 // Invoked when received GET CONFIGURATION DESCRIPTOR
 // Application return pointer to descriptor
 // Descriptor contents must exist long enough for transfer to complete
@@ -99,6 +128,6 @@ uint8_t const *tud_descriptor_configuration_cb(uint8_t index)
 			return keyboard_configuration_descriptor;
 
 		default:
-			return hid_configuration_descriptor;
+			return get_hid_configuration_descriptor();
 	}
 }
\ No newline at end of file
@@ -15,7 +15,17 @@ typedef enum
 
 InputMode get_input_mode(void);
 bool get_usb_mounted(void);
-void initialize_driver(InputMode mode);
+uint8_t get_player_count(void);
+// players > 1: one HID interface per player, in HID mode only
+void initialize_driver(InputMode mode, uint8_t players = 1);
 void receive_report(uint8_t *buffer);
-void send_report(void *report, uint16_t report_size);
+// Returns true when a new report was handed to the IN endpoint
+bool send_report(void *report, uint16_t report_size);
+// Report of another player than the first, on its own HID interface
+void send_player_report(uint8_t player, void *report, uint16_t report_size);
 
+// Start-of-frame hook, called from the USB interrupt with the frame number while the device is mounted
+typedef void (*sof_callback_t)(uint32_t frame_count);
+void set_sof_callback(sof_callback_t callback);
+// Class driver SOF handler, shared by the gamepad drivers
+void usb_driver_sof_cb(uint8_t rhport, uint32_t frame_count);
@@ -4,6 +4,7 @@
  */
 
 #include "xinput_driver.h"
+#include "usb_driver.h"
 
 uint8_t endpoint_in = 0;
 uint8_t endpoint_out = 0;
@@ -115,4 +116,4 @@ const usbd_class_driver_t xinput_driver =
 		.open = xinput_open,
 		.control_xfer_cb = xinput_device_control_request,
 		.xfer_cb = xinput_xfer_callback,
-		.sof = NULL};
+		.sof = usb_driver_sof_cb};
@@ -1,39 +1,181 @@
 #include "addonmanager.h"
 
-void AddonManager::LoadAddon(GPAddon* addon, ADDON_PROCESS processAt) {
-    if (addon->available()) {
-        AddonBlock * block = new AddonBlock;
-		addon->setup();
-        block->ptr = addon;
-        block->process = processAt;
-        addons.push_back(block);
-	} else {
-        delete addon; // Don't use the memory if we don't have to
+#include <cstring>
+#include <string>
+
+#include "pico/stdlib.h"
+
+#include "persistentstats.h"
+
+static const uint32_t ADDON_TIMINGS_MAGIC = 0x41444454; // "ADDT"
+
+struct AddonTimings {
+    uint32_t count;
+    AddonTiming timings[MAX_ADDON_TIMINGS]; // each one set up as its addon registers
+
+    void reset() {
+        count = 0;
     }
+};
+
+static PersistentStats<AddonTimings, ADDON_TIMINGS_MAGIC> __uninitialized_ram(persistentAddonTimings);
+static bool recordingAddonTimings = false;
+
+// Split addons of all the managers, for core1
+struct SplitAddon {
+    GPAddon * ptr;
+    void (*acquire)(GPAddon *);
+    AddonTiming * timing;
+};
+
+static SplitAddon splitAddons[MAX_SPLIT_ADDONS];
+static volatile uint32_t splitAddonCount = 0;
+
+void startAddonTimings() {
+    persistentAddonTimings.reset();
+    recordingAddonTimings = true;
 }
 
+uint32_t getAddonTimingCount() {
+    return persistentAddonTimings.get().count;
+}
 
-void AddonManager::PreprocessAddons(ADDON_PROCESS processType) {
-    // Loop through all addons and process any that match our type
-    for (std::vector<AddonBlock*>::iterator it = addons.begin(); it != addons.end(); it++) {
-        if ( (*it)->process == processType )
-            (*it)->ptr->preprocess();
+const AddonTiming& getAddonTiming(uint32_t index) {
+    return persistentAddonTimings.stats.timings[index];
+}
+
+// Core0 loads its addons before it launches core1, so they never register at the same time
+AddonBlock & AddonManager::AddBlock(GPAddon * addon, ADDON_PROCESS processAt, void (*preprocess)(GPAddon *), void (*process)(GPAddon *)) {
+    AddonBlock & block = blocks[processAt][counts[processAt]++];
+    block.ptr = addon;
+    block.preprocess = preprocess;
+    block.process = process;
+    block.timing = nullptr;
+    block.budgetUs = processAt == CORE1_LOOP ? 0 : ADDON_BUDGET_US;
+    block.overrunStreak = 0;
+    block.suspended = false;
+    block.retrying = false;
+    block.resumeUs = 0;
+    block.backoffUs = ADDON_BACKOFF_MIN_US;
+
+    const std::string name = addon->name();
+    strncpy(block.name, name.c_str(), ADDON_NAME_SIZE - 1);
+    block.name[ADDON_NAME_SIZE - 1] = '\0';
+
+    AddonTimings & timings = persistentAddonTimings.stats;
+    if (recordingAddonTimings && timings.count < MAX_ADDON_TIMINGS) {
+        AddonTiming & timing = timings.timings[timings.count++];
+        timing = {};
+        memcpy(timing.name, block.name, ADDON_NAME_SIZE);
+        timing.process = processAt;
+        block.timing = &timing;
     }
+
+    return block;
 }
 
-void AddonManager::ProcessAddons(ADDON_PROCESS processType) {
-    // Loop through all addons and process any that match our type
-    for (std::vector<AddonBlock*>::iterator it = addons.begin(); it != addons.end(); it++) {
-        if ( (*it)->process == processType )
-            (*it)->ptr->process();
+// Core1 only starts once core0 has loaded its addons, so it sees them all
+void AddonManager::AddSplit(const AddonBlock & block, void (*acquire)(GPAddon *)) {
+    if (splitAddonCount == MAX_SPLIT_ADDONS)
+        return;
+
+    splitAddons[splitAddonCount] = { block.ptr, acquire, block.timing };
+    splitAddonCount = splitAddonCount + 1;
+}
+
+void AddonManager::AcquireAddons() {
+    for (uint32_t i = 0; i < splitAddonCount; i++) {
+        const SplitAddon & split = splitAddons[i];
+        const uint32_t start = time_us_32();
+        split.acquire(split.ptr);
+        const uint32_t elapsed = time_us_32() - start;
+
+        if (split.timing && elapsed > split.timing->acquireWorstUs)
+            split.timing->acquireWorstUs = elapsed;
     }
 }
 
+static void suspend(AddonBlock & block, uint32_t now) {
+    block.suspended = true;
+    block.resumeUs = now + block.backoffUs;
+    block.backoffUs = block.backoffUs < ADDON_BACKOFF_MAX_US / 2 ? block.backoffUs * 2 : ADDON_BACKOFF_MAX_US;
+    block.overrunStreak = 0;
+    if (block.timing)
+        block.timing->suspensions++;
+}
+
+static inline void runTimed(void (*call)(GPAddon *), AddonBlock & block, uint32_t phaseStart) {
+    if (!block.timing && !block.budgetUs) {
+        call(block.ptr);
+        return;
+    }
+
+    const uint32_t start = time_us_32();
+
+    if (block.suspended) {
+        if ((int32_t)(start - block.resumeUs) < 0)
+            return;
+        block.suspended = false;
+        block.retrying = true;
+    }
+
+    if (block.budgetUs && start - phaseStart >= ADDON_PHASE_BUDGET_US) {
+        if (block.timing)
+            block.timing->deferred++;
+        return;
+    }
+
+    call(block.ptr);
+    const uint32_t end = time_us_32();
+    const uint32_t elapsed = end - start;
+
+    const bool overrun = block.budgetUs && elapsed > block.budgetUs;
+    if (block.retrying) {
+        block.retrying = false;
+        if (overrun)
+            suspend(block, end);
+        else
+            block.backoffUs = ADDON_BACKOFF_MIN_US;
+    } else {
+        block.overrunStreak = overrun ? block.overrunStreak + 1 : 0;
+        if (block.overrunStreak == ADDON_OVERRUN_LIMIT)
+            suspend(block, end);
+    }
+
+    if (!block.timing)
+        return;
+
+    AddonTiming & timing = *block.timing;
+    timing.calls++;
+    timing.totalUs += elapsed;
+    if (elapsed > timing.worstUs)
+        timing.worstUs = elapsed;
+    if (overrun)
+        timing.overruns++;
+    timing.suspended = block.suspended;
+}
+
+void AddonManager::PreprocessAddons(ADDON_PROCESS processType) {
+    AddonBlock * phase = blocks[processType];
+    const uint32_t phaseStart = time_us_32();
+    for (uint32_t i = 0; i < counts[processType]; i++)
+        runTimed(phase[i].preprocess, phase[i], phaseStart);
+}
+
+void AddonManager::ProcessAddons(ADDON_PROCESS processType) {
+    AddonBlock * phase = blocks[processType];
+    const uint32_t phaseStart = time_us_32();
+    for (uint32_t i = 0; i < counts[processType]; i++)
+        runTimed(phase[i].process, phase[i], phaseStart);
+}
+
 // HACK : change this for NeoPicoLED
-GPAddon * AddonManager::GetAddon(std::string name) { // hack for NeoPicoLED
-    for (std::vector<AddonBlock*>::iterator it = addons.begin(); it != addons.end(); it++) {
-        if ( (*it)->ptr->name() == name )
-            return (*it)->ptr;
+GPAddon * AddonManager::GetAddon(const char * name) { // hack for NeoPicoLED
+    for (uint32_t process = 0; process < ADDON_PROCESS_COUNT; process++) {
+        for (uint32_t i = 0; i < counts[process]; i++) {
+            if (strcmp(blocks[process][i].name, name) == 0)
+                return blocks[process][i].ptr;
+        }
     }
     return nullptr;
 }
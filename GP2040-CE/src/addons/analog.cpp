@@ -20,11 +20,13 @@ void AnalogInput::setup() {
         adc_gpio_init(analogAdcPinX);
     if ( analogAdcPinY != (uint8_t)-1)
         adc_gpio_init(analogAdcPinY);
+
+    // Centered until core1 reads the ADC
+    latest.publish({ GAMEPAD_JOYSTICK_MID, GAMEPAD_JOYSTICK_MID });
 }
 
-void AnalogInput::process()
+void AnalogInput::acquire()
 {
-    Gamepad * gamepad = Storage::getInstance().GetGamepad();
     float adc_x = ANALOG_CENTER;
     float adc_y = ANALOG_CENTER;
     if ( analogAdcPinX != (uint8_t)-1) {
@@ -41,6 +43,15 @@ void AnalogInput::process()
         adc_y = ANALOG_CENTER;
 
     // Convert to 16-bit value
-    gamepad->state.lx = (uint16_t)(65535.0f*adc_x);
-    gamepad->state.ly = (uint16_t)(65535.0f*adc_y);
+    latest.publish({ (uint16_t)(65535.0f*adc_x), (uint16_t)(65535.0f*adc_y) });
+}
+
+void AnalogInput::process()
+{
+    AnalogSample sample;
+    latest.read(sample);
+
+    Gamepad * gamepad = Storage::getInstance().GetGamepad();
+    gamepad->state.lx = sample.x;
+    gamepad->state.ly = sample.y;
 }
@@ -18,19 +18,19 @@ void BoardLedAddon::setup() {
 
 void BoardLedAddon::process() {
     bool state = 0;
-    Gamepad * gamepad;
+    const GamepadState * gamepadState;
     switch (onBoardLedMode) {
         case OnBoardLedMode::INPUT_TEST: // Blinks on input
-            gamepad = Storage::getInstance().GetGamepad();
-            state =    (gamepad->rawState.buttons != 0)
-                    || (gamepad->rawState.dpad    != 0)
-                    || (gamepad->rawState.lx      != GAMEPAD_JOYSTICK_MID)
-                    || (gamepad->rawState.rx      != GAMEPAD_JOYSTICK_MID)
-                    || (gamepad->rawState.ly      != GAMEPAD_JOYSTICK_MID)
-                    || (gamepad->rawState.ry      != GAMEPAD_JOYSTICK_MID)
-                    || (gamepad->rawState.lt      != 0)
-                    || (gamepad->rawState.rt      != 0)
-                    || (gamepad->rawState.aux     != 0);
+            gamepadState = &Storage::getInstance().GetProcessedGamepad()->state; // core0's last published state
+            state =    (gamepadState->buttons != 0)
+                    || (gamepadState->dpad    != 0)
+                    || (gamepadState->lx      != GAMEPAD_JOYSTICK_MID)
+                    || (gamepadState->rx      != GAMEPAD_JOYSTICK_MID)
+                    || (gamepadState->ly      != GAMEPAD_JOYSTICK_MID)
+                    || (gamepadState->ry      != GAMEPAD_JOYSTICK_MID)
+                    || (gamepadState->lt      != 0)
+                    || (gamepadState->rt      != 0)
+                    || (gamepadState->aux     != 0);
             if (prevState != state) {
                 gpio_put(BOARD_LED_PIN, state ? 1 : 0);
             }
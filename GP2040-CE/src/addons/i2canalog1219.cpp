@@ -36,7 +36,7 @@ void I2CAnalog1219Input::setup() {
     ads->start();                               // START/SYNC command
 }
 
-void I2CAnalog1219Input::process()
+void I2CAnalog1219Input::acquire()
 {
     if (nextTimer < getMillis()) {
         float result;
@@ -48,13 +48,20 @@ void I2CAnalog1219Input::process()
             channelHop = (channelHop+1) % 4; // Loop 0-3
             ads->setChannel(channelHop);
             nextTimer = getMillis() + uIntervalMS; // interval for read (we can't be too fast)
+            latest.publish(pins);
         }
     }
+}
+
+void I2CAnalog1219Input::process()
+{
+    ADS_PINS sample;
+    latest.read(sample);
 
     Gamepad * gamepad = Storage::getInstance().GetGamepad();
-    gamepad->state.lx = (uint16_t)(65535.f*pins.A[0]);
-    gamepad->state.ly = (uint16_t)(65535.f*pins.A[1]);
-    gamepad->state.rx = (uint16_t)(65535.f*pins.A[2]);
-    gamepad->state.ry = (uint16_t)(65535.f*pins.A[3]);
+    gamepad->state.lx = (uint16_t)(65535.f*sample.A[0]);
+    gamepad->state.ly = (uint16_t)(65535.f*sample.A[1]);
+    gamepad->state.rx = (uint16_t)(65535.f*sample.A[2]);
+    gamepad->state.ry = (uint16_t)(65535.f*sample.A[3]);
 
 }
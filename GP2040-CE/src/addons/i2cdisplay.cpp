@@ -60,7 +60,7 @@ bool I2CDisplayAddon::isDisplayPowerOff()
 	float diffTime = getMillis() - prevMillis;
 	displaySaverTimer -= diffTime;
 
-	if (gamepad->state.buttons || gamepad->state.dpad) {
+	if (pGamepad->state.buttons || pGamepad->state.dpad) {
 		displaySaverTimer = displaySaverTimeout;
 		setDisplayPower(1);
 	} else if (displaySaverTimer <= 0) {
@@ -210,8 +210,7 @@ void I2CDisplayAddon::process() {
 
 I2CDisplayAddon::DisplayMode I2CDisplayAddon::getDisplayMode() {
 	if (configMode) {
-		gamepad->read();
-		uint16_t buttonState = gamepad->state.buttons;
+		uint16_t buttonState = pGamepad->state.buttons;
 		if (prevButtonState && !buttonState) { // has button been pressed (held and released)?
 			switch (prevButtonState) {
 				case (GAMEPAD_MASK_B1):
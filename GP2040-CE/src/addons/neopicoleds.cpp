@@ -115,7 +115,7 @@ void NeoPicoLEDAddon::process()
 		return;
 
 	Gamepad * gamepad = Storage::getInstance().GetProcessedGamepad();
-	uint8_t * featureData = Storage::getInstance().GetFeatureData();
+	uint8_t * featureData = Storage::getInstance().GetProcessedFeatureData();
 	AnimationHotkey action = animationHotkeys(gamepad);
 	if (PLED_TYPE == PLED_TYPE_RGB) {
 		inputMode = gamepad->options.inputMode; // HACK
@@ -102,7 +102,7 @@ void PlayerLEDAddon::process()
 	Gamepad * gamepad = Storage::getInstance().GetProcessedGamepad();
 
 	// Player LEDs can be PWM or driven by NeoPixel
-	uint8_t * featureData = Storage::getInstance().GetFeatureData();
+	uint8_t * featureData = Storage::getInstance().GetProcessedFeatureData();
 	if (PLED_TYPE == PLED_TYPE_PWM) { // only process the feature queue if we're on PWM
 		if (pwmLEDs != nullptr)
 			pwmLEDs->display();
@@ -31,114 +31,121 @@ void WiiExtensionInput::setup() {
     wii->start();
 }
 
-void WiiExtensionInput::process() {
+void WiiExtensionInput::acquire() {
     if (nextTimer < getMillis()) {
         wii->poll();
         
         if (wii->extensionType == WII_EXTENSION_NUNCHUCK) {
-            buttonZ = wii->buttonZ;
-            buttonC = wii->buttonC;
+            sample.buttonZ = wii->buttonZ;
+            sample.buttonC = wii->buttonC;
 
-            leftX = map(wii->joy1X,0,1023,GAMEPAD_JOYSTICK_MIN,GAMEPAD_JOYSTICK_MAX);
-            leftY = map(wii->joy1Y,1023,0,GAMEPAD_JOYSTICK_MIN,GAMEPAD_JOYSTICK_MAX);
-            rightX = GAMEPAD_JOYSTICK_MID;
-            rightY = GAMEPAD_JOYSTICK_MID;
+            sample.leftX = map(wii->joy1X,0,1023,GAMEPAD_JOYSTICK_MIN,GAMEPAD_JOYSTICK_MAX);
+            sample.leftY = map(wii->joy1Y,1023,0,GAMEPAD_JOYSTICK_MIN,GAMEPAD_JOYSTICK_MAX);
+            sample.rightX = GAMEPAD_JOYSTICK_MID;
+            sample.rightY = GAMEPAD_JOYSTICK_MID;
 
-            triggerLeft = 0;
-            triggerRight = 0;
+            sample.triggerLeft = 0;
+            sample.triggerRight = 0;
         } else if ((wii->extensionType == WII_EXTENSION_CLASSIC) || (wii->extensionType == WII_EXTENSION_CLASSIC_PRO)) {
-            buttonA = wii->buttonA;
-            buttonB = wii->buttonB;
-            buttonX = wii->buttonX;
-            buttonY = wii->buttonY;
-            buttonL = wii->buttonZL;
-            buttonZL = wii->buttonLT;
-            buttonR = wii->buttonZR;
-            buttonZR = wii->buttonRT;
-            dpadUp = wii->directionUp;
-            dpadDown = wii->directionDown;
-            dpadLeft = wii->directionLeft;
-            dpadRight = wii->directionRight;
-            buttonSelect = wii->buttonMinus;
-            buttonStart = wii->buttonPlus;
-            buttonHome = wii->buttonHome;
+            sample.buttonA = wii->buttonA;
+            sample.buttonB = wii->buttonB;
+            sample.buttonX = wii->buttonX;
+            sample.buttonY = wii->buttonY;
+            sample.buttonL = wii->buttonZL;
+            sample.buttonZL = wii->buttonLT;
+            sample.buttonR = wii->buttonZR;
+            sample.buttonZR = wii->buttonRT;
+            sample.dpadUp = wii->directionUp;
+            sample.dpadDown = wii->directionDown;
+            sample.dpadLeft = wii->directionLeft;
+            sample.dpadRight = wii->directionRight;
+            sample.buttonSelect = wii->buttonMinus;
+            sample.buttonStart = wii->buttonPlus;
+            sample.buttonHome = wii->buttonHome;
 
             if (wii->extensionType == WII_EXTENSION_CLASSIC) {
-                triggerLeft  = wii->triggerLeft;
-                triggerRight = wii->triggerRight;
+                sample.triggerLeft  = wii->triggerLeft;
+                sample.triggerRight = wii->triggerRight;
             }
 
-            leftX = map(wii->joy1X,0,WII_ANALOG_PRECISION_3,GAMEPAD_JOYSTICK_MIN,GAMEPAD_JOYSTICK_MAX);
-            leftY = map(wii->joy1Y,WII_ANALOG_PRECISION_3,0,GAMEPAD_JOYSTICK_MIN,GAMEPAD_JOYSTICK_MAX);
-            rightX = map(wii->joy2X,0,WII_ANALOG_PRECISION_3,GAMEPAD_JOYSTICK_MIN,GAMEPAD_JOYSTICK_MAX);
-            rightY = map(wii->joy2Y,WII_ANALOG_PRECISION_3,0,GAMEPAD_JOYSTICK_MIN,GAMEPAD_JOYSTICK_MAX);
+            sample.leftX = map(wii->joy1X,0,WII_ANALOG_PRECISION_3,GAMEPAD_JOYSTICK_MIN,GAMEPAD_JOYSTICK_MAX);
+            sample.leftY = map(wii->joy1Y,WII_ANALOG_PRECISION_3,0,GAMEPAD_JOYSTICK_MIN,GAMEPAD_JOYSTICK_MAX);
+            sample.rightX = map(wii->joy2X,0,WII_ANALOG_PRECISION_3,GAMEPAD_JOYSTICK_MIN,GAMEPAD_JOYSTICK_MAX);
+            sample.rightY = map(wii->joy2Y,WII_ANALOG_PRECISION_3,0,GAMEPAD_JOYSTICK_MIN,GAMEPAD_JOYSTICK_MAX);
         } else if (wii->extensionType == WII_EXTENSION_GUITAR) {
-            buttonSelect = wii->buttonMinus;
-            buttonStart = wii->buttonPlus;
+            sample.buttonSelect = wii->buttonMinus;
+            sample.buttonStart = wii->buttonPlus;
 
-            dpadUp = wii->directionUp;
-            dpadDown = wii->directionDown;
+            sample.dpadUp = wii->directionUp;
+            sample.dpadDown = wii->directionDown;
 
-            buttonB = wii->fretGreen;
-            buttonA = wii->fretRed;
-            buttonX = wii->fretYellow;
-            buttonY = wii->fretBlue;
-            buttonL = wii->fretOrange;
+            sample.buttonB = wii->fretGreen;
+            sample.buttonA = wii->fretRed;
+            sample.buttonX = wii->fretYellow;
+            sample.buttonY = wii->fretBlue;
+            sample.buttonL = wii->fretOrange;
 
             // whammy currently maps to Joy2X in addition to the raw whammy value
-            whammyBar = wii->whammyBar;
+            sample.whammyBar = wii->whammyBar;
 
-            leftX = map(wii->joy1X,0,WII_ANALOG_PRECISION_3,GAMEPAD_JOYSTICK_MIN,GAMEPAD_JOYSTICK_MAX);
-            leftY = map(wii->joy1Y,WII_ANALOG_PRECISION_3,0,GAMEPAD_JOYSTICK_MIN,GAMEPAD_JOYSTICK_MAX);
-            rightX = map(wii->joy2X,0,WII_ANALOG_PRECISION_3,GAMEPAD_JOYSTICK_MID,GAMEPAD_JOYSTICK_MAX);
-            rightY = GAMEPAD_JOYSTICK_MID;
+            sample.leftX = map(wii->joy1X,0,WII_ANALOG_PRECISION_3,GAMEPAD_JOYSTICK_MIN,GAMEPAD_JOYSTICK_MAX);
+            sample.leftY = map(wii->joy1Y,WII_ANALOG_PRECISION_3,0,GAMEPAD_JOYSTICK_MIN,GAMEPAD_JOYSTICK_MAX);
+            sample.rightX = map(wii->joy2X,0,WII_ANALOG_PRECISION_3,GAMEPAD_JOYSTICK_MID,GAMEPAD_JOYSTICK_MAX);
+            sample.rightY = GAMEPAD_JOYSTICK_MID;
 
-            triggerLeft = 0;
-            triggerRight = 0;
+            sample.triggerLeft = 0;
+            sample.triggerRight = 0;
         } else if (wii->extensionType == WII_EXTENSION_TAIKO) {
-            buttonL = wii->rimLeft;
-            buttonR = wii->rimRight;
+            sample.buttonL = wii->rimLeft;
+            sample.buttonR = wii->rimRight;
 
-            dpadRight = wii->drumLeft;
-            buttonA = wii->drumRight;
+            sample.dpadRight = wii->drumLeft;
+            sample.buttonA = wii->drumRight;
         }
                
+        sample.extensionType = wii->extensionType;
         nextTimer = getMillis() + uIntervalMS;
+        latest.publish(sample);
     }
+}
+
+void WiiExtensionInput::process() {
+    WiiExtensionSample merged;
+    latest.read(merged);
 
     Gamepad * gamepad = Storage::getInstance().GetGamepad();
 
-    gamepad->state.lx = leftX;
-    gamepad->state.ly = leftY;
-    gamepad->state.rx = rightX;
-    gamepad->state.ry = rightY;
+    gamepad->state.lx = merged.leftX;
+    gamepad->state.ly = merged.leftY;
+    gamepad->state.rx = merged.rightX;
+    gamepad->state.ry = merged.rightY;
 
-    if (wii->extensionType == WII_EXTENSION_CLASSIC) {
+    if (merged.extensionType == WII_EXTENSION_CLASSIC) {
         gamepad->hasAnalogTriggers = true;
-        gamepad->state.lt = triggerLeft;
-        gamepad->state.rt = triggerRight;
+        gamepad->state.lt = merged.triggerLeft;
+        gamepad->state.rt = merged.triggerRight;
     } else {
         gamepad->hasAnalogTriggers = false;
     }
 
-    if (buttonC) gamepad->state.buttons |= GAMEPAD_MASK_B1;
-    if (buttonZ) gamepad->state.buttons |= GAMEPAD_MASK_B2;
-
-    if (buttonA) gamepad->state.buttons |= GAMEPAD_MASK_B2;
-    if (buttonB) gamepad->state.buttons |= GAMEPAD_MASK_B1;
-    if (buttonX) gamepad->state.buttons |= GAMEPAD_MASK_B4;
-    if (buttonY) gamepad->state.buttons |= GAMEPAD_MASK_B3;
-    if (buttonL) gamepad->state.buttons |= GAMEPAD_MASK_L1;
-    if (buttonZL) gamepad->state.buttons |= GAMEPAD_MASK_L2;
-    if (buttonR) gamepad->state.buttons |= GAMEPAD_MASK_R1;
-    if (buttonZR) gamepad->state.buttons |= GAMEPAD_MASK_R2;
-    if (buttonSelect) gamepad->state.buttons |= GAMEPAD_MASK_S1;
-    if (buttonStart) gamepad->state.buttons |= GAMEPAD_MASK_S2;
-    if (buttonHome) gamepad->state.buttons |= GAMEPAD_MASK_A1;
-    if (dpadUp) gamepad->state.dpad |= GAMEPAD_MASK_UP;
-    if (dpadDown) gamepad->state.dpad |= GAMEPAD_MASK_DOWN;
-    if (dpadLeft) gamepad->state.dpad |= GAMEPAD_MASK_LEFT;
-    if (dpadRight) gamepad->state.dpad |= GAMEPAD_MASK_RIGHT;
+    if (merged.buttonC) gamepad->state.buttons |= GAMEPAD_MASK_B1;
+    if (merged.buttonZ) gamepad->state.buttons |= GAMEPAD_MASK_B2;
+
+    if (merged.buttonA) gamepad->state.buttons |= GAMEPAD_MASK_B2;
+    if (merged.buttonB) gamepad->state.buttons |= GAMEPAD_MASK_B1;
+    if (merged.buttonX) gamepad->state.buttons |= GAMEPAD_MASK_B4;
+    if (merged.buttonY) gamepad->state.buttons |= GAMEPAD_MASK_B3;
+    if (merged.buttonL) gamepad->state.buttons |= GAMEPAD_MASK_L1;
+    if (merged.buttonZL) gamepad->state.buttons |= GAMEPAD_MASK_L2;
+    if (merged.buttonR) gamepad->state.buttons |= GAMEPAD_MASK_R1;
+    if (merged.buttonZR) gamepad->state.buttons |= GAMEPAD_MASK_R2;
+    if (merged.buttonSelect) gamepad->state.buttons |= GAMEPAD_MASK_S1;
+    if (merged.buttonStart) gamepad->state.buttons |= GAMEPAD_MASK_S2;
+    if (merged.buttonHome) gamepad->state.buttons |= GAMEPAD_MASK_A1;
+    if (merged.dpadUp) gamepad->state.dpad |= GAMEPAD_MASK_UP;
+    if (merged.dpadDown) gamepad->state.dpad |= GAMEPAD_MASK_DOWN;
+    if (merged.dpadLeft) gamepad->state.dpad |= GAMEPAD_MASK_LEFT;
+    if (merged.dpadRight) gamepad->state.dpad |= GAMEPAD_MASK_RIGHT;
 }
 
 uint16_t WiiExtensionInput::map(uint16_t x, uint16_t in_min, uint16_t in_max, uint16_t out_min, uint16_t out_max) {
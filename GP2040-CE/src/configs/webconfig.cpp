@@ -5,12 +5,19 @@
 #include "configmanager.h"
 #include "AnimationStorage.hpp"
 #include "system.h"
+#include "sofscheduler.h"
+#include "loopwake.h"
+#include "stageprofiler.h"
+#include "latencytracer.h"
+#include "addonmanager.h"
+#include "gba/GBALibrary.h"
 
 #include <cstring>
 #include <string>
 #include <vector>
 
 #include <pico/types.h>
+#include <hardware/clocks.h>
 
 // HTTPD Includes
 #include <ArduinoJson.h>
@@ -108,6 +115,13 @@ static void __attribute__((noinline)) writeDoc(DynamicJsonDocument& doc, const K
 	doc[key0][key1][key2] = var;
 }
 
+// Don't inline this function, we do not want to consume stack space in the calling function
+template <typename T, typename K0, typename K1, typename K2, typename K3>
+static void __attribute__((noinline)) writeDoc(DynamicJsonDocument& doc, const K0& key0, const K1& key1, const K2& key2, const K3& key3, const T& var)
+{
+	doc[key0][key1][key2][key3] = var;
+}
+
 void WebConfig::setup() {
 	rndis_init();
 }
@@ -383,6 +397,7 @@ std::string setGamepadOptions()
 	readDoc(gamepad->options.dpadMode, doc, "dpadMode");
 	readDoc(gamepad->options.inputMode, doc, "inputMode");
 	readDoc(gamepad->options.socdMode, doc, "socdMode");
+	docToValue(gamepad->options.gbaRom, doc, "gbaRom");
 
 	readDoc(gamepad->options.hotkeyF1Up.action, doc, "hotkeyF1", 0, "action");
 	readDoc(gamepad->options.hotkeyF1Down.action, doc, "hotkeyF1", 1, "action");
@@ -406,6 +421,7 @@ std::string getGamepadOptions()
 	writeDoc(doc, "dpadMode", options.dpadMode);
 	writeDoc(doc, "inputMode", options.inputMode);
 	writeDoc(doc, "socdMode", options.socdMode);
+	writeDoc(doc, "gbaRom", options.gbaRom);
 
 	writeDoc(doc, "hotkeyF1", 0, "action", options.hotkeyF1Up.action);
 	writeDoc(doc, "hotkeyF1", 0, "mask", options.hotkeyF1Up.dpadMask);
@@ -1019,6 +1035,132 @@ std::string getMemoryReport()
 	return serialize_json(doc);
 }
 
+std::string getGBALinkStats()
+{
+	DynamicJsonDocument doc(LWIP_HTTPD_POST_MAX_PAYLOAD_LEN);
+	const gba::MultibootStats& stats = Storage::getInstance().GetGamepad()->getGBAStats();
+	writeDoc(doc, "uploads", stats.uploads);
+	writeDoc(doc, "headerErrors", stats.headerErrors);
+	writeDoc(doc, "seedErrors", stats.seedErrors);
+	writeDoc(doc, "bodyErrors", stats.bodyErrors);
+	writeDoc(doc, "bodyOffset", stats.bodyOffset);
+	writeDoc(doc, "crcErrors", stats.crcErrors);
+	writeDoc(doc, "loaderErrors", stats.loaderErrors);
+	return serialize_json(doc);
+}
+
+std::string getPollStats()
+{
+	DynamicJsonDocument doc(LWIP_HTTPD_POST_MAX_PAYLOAD_LEN);
+	const CycleStats& stats = getCycleStats();
+	writeDoc(doc, "periodUs", stats.periodUs);
+	writeDoc(doc, "cycles", stats.cycles);
+	writeDoc(doc, "worstUs", stats.worstUs);
+	writeDoc(doc, "overruns", stats.overruns);
+	for (uint32_t core = 0; core < 2; core++)
+	{
+		const WakeStats& wake = getWakeStats(core);
+		writeDoc(doc, "wake", core, "deadlines", wake.deadlines);
+		writeDoc(doc, "wake", core, "doorbells", wake.doorbells);
+		writeDoc(doc, "wake", core, "worstLateUs", wake.worstLateUs);
+		writeDoc(doc, "wake", core, "averageLateUs", wake.deadlines ? wake.totalLateUs / wake.deadlines : 0);
+	}
+	return serialize_json(doc);
+}
+
+// In CPU cycles (`clockHz` a second), per stage of the core0 gamepad cycle
+std::string getStageProfile()
+{
+	DynamicJsonDocument doc(LWIP_HTTPD_POST_MAX_PAYLOAD_LEN);
+	writeDoc(doc, "enabled", GAMEPAD_STAGE_PROFILE ? true : false);
+	writeDoc(doc, "clockHz", clock_get_hz(clk_sys));
+#if GAMEPAD_STAGE_PROFILE
+	for (uint32_t i = 0; i < (uint32_t)ProfileStage::COUNT; i++)
+	{
+		const ProfileStage stage = (ProfileStage)i;
+		const StageProfile& profile = getStageProfile(stage);
+		writeDoc(doc, "stages", i, "name", getStageName(stage));
+		writeDoc(doc, "stages", i, "count", profile.count);
+		writeDoc(doc, "stages", i, "min", profile.count ? profile.min : 0);
+		writeDoc(doc, "stages", i, "max", profile.max);
+		writeDoc(doc, "stages", i, "p50", profile.getPercentile(500));
+		writeDoc(doc, "stages", i, "p90", profile.getPercentile(900));
+		writeDoc(doc, "stages", i, "p99", profile.getPercentile(990));
+		writeDoc(doc, "stages", i, "p999", profile.getPercentile(999));
+	}
+#endif
+	return serialize_json(doc);
+}
+
+// In microseconds, per input mode that traced any key edge (`mode` as in `getGamepadOptions`)
+std::string getLatencyStats()
+{
+	DynamicJsonDocument doc(LWIP_HTTPD_POST_MAX_PAYLOAD_LEN);
+	writeDoc(doc, "enabled", GAMEPAD_LATENCY_TRACE ? true : false);
+#if GAMEPAD_LATENCY_TRACE
+	uint32_t index = 0;
+	for (uint32_t mode = 0; mode < LATENCY_INPUT_MODES; mode++)
+	{
+		const LatencyStats& stats = getLatencyStats((InputMode)mode);
+		if (stats.legs[(uint32_t)LatencyLeg::TOTAL].count == 0)
+			continue;
+
+		writeDoc(doc, "modes", index, "mode", mode);
+		writeDoc(doc, "modes", index, "overlapped", stats.overlapped);
+		for (uint32_t i = 0; i < (uint32_t)LatencyLeg::COUNT; i++)
+		{
+			const LatencyHistogram& leg = stats.legs[i];
+			const char * name = getLatencyLegName((LatencyLeg)i);
+			writeDoc(doc, "modes", index, name, "count", leg.count);
+			writeDoc(doc, "modes", index, name, "min", leg.count ? leg.min : 0);
+			writeDoc(doc, "modes", index, name, "max", leg.max);
+			writeDoc(doc, "modes", index, name, "p50", leg.getPercentile(500));
+			writeDoc(doc, "modes", index, name, "p90", leg.getPercentile(900));
+			writeDoc(doc, "modes", index, name, "p99", leg.getPercentile(990));
+		}
+		index++;
+	}
+#endif
+	return serialize_json(doc);
+}
+
+std::string getAddonTimings()
+{
+	DynamicJsonDocument doc(LWIP_HTTPD_POST_MAX_PAYLOAD_LEN);
+	const uint32_t count = getAddonTimingCount();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const AddonTiming& timing = getAddonTiming(i);
+		writeDoc(doc, "addons", i, "name", std::string(timing.name, strnlen(timing.name, ADDON_NAME_SIZE)));
+		writeDoc(doc, "addons", i, "process", timing.process);
+		writeDoc(doc, "addons", i, "calls", timing.calls);
+		writeDoc(doc, "addons", i, "averageUs", timing.calls ? (uint32_t)(timing.totalUs / timing.calls) : 0);
+		writeDoc(doc, "addons", i, "worstUs", timing.worstUs);
+		writeDoc(doc, "addons", i, "overruns", timing.overruns);
+		writeDoc(doc, "addons", i, "suspensions", timing.suspensions);
+		writeDoc(doc, "addons", i, "suspended", timing.suspended ? true : false);
+		writeDoc(doc, "addons", i, "deferred", timing.deferred);
+		writeDoc(doc, "addons", i, "acquireWorstUs", timing.acquireWorstUs);
+	}
+	return serialize_json(doc);
+}
+
+std::string getGBALibrary()
+{
+	DynamicJsonDocument doc(LWIP_HTTPD_POST_MAX_PAYLOAD_LEN);
+	const gba::GBALibraryHeader* library = gba::getGBALibrary();
+	const uint32_t count = library ? library->count : 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const gba::GBALibraryEntry& entry = library->entries[i];
+		writeDoc(doc, "roms", i, "name", std::string(entry.name, strnlen(entry.name, gba::GBA_LIBRARY_NAME_SIZE)));
+		writeDoc(doc, "roms", i, "keys", entry.keys);
+		writeDoc(doc, "roms", i, "fingerprint", entry.fingerprint);
+		writeDoc(doc, "roms", i, "size", entry.size);
+	}
+	return serialize_json(doc);
+}
+
 // This should be a storage feature
 std::string resetSettings()
 {
@@ -1084,6 +1226,12 @@ static const std::pair<const char*, HandlerFuncPtr> handlerFuncs[] =
 	{ "/api/getSplashImage", getSplashImage },
 	{ "/api/getFirmwareVersion", getFirmwareVersion },
 	{ "/api/getMemoryReport", getMemoryReport },
+	{ "/api/getGBALinkStats", getGBALinkStats },
+	{ "/api/getPollStats", getPollStats },
+	{ "/api/getStageProfile", getStageProfile },
+	{ "/api/getLatencyStats", getLatencyStats },
+	{ "/api/getAddonTimings", getAddonTimings },
+	{ "/api/getGBALibrary", getGBALibrary },
 #if !defined(NDEBUG)
 	{ "/api/echo", echo },
 #endif
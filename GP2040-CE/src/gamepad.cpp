@@ -14,7 +14,19 @@
 #include "CRC32.h"
 
 #include "gba/spi32.h"
+#include "gba/multiplay.h"
 #include "gba/GBAKey.h"
+#include "gba/GBALibrary.h"
+
+static_assert(!GBA_LINK_MULTI || GBA_LINK_PLAYERS == gba::GBA_MULTI_CLIENTS);
+// Multi-Play takes over the pins of the first port
+static_assert(!GBA_LINK_MULTI || GBA_LINK_PORTS == 1);
+
+// Every sample starts a background exchange, which must be done before the next one (`GAMEPAD_POLL_1KHZ` and
+// `GAMEPAD_CORE1_INPUT` included): a whole Multi-Play transfer, or a link exchange at the slowest rate,
+// with as long again for the GBA to get ready
+static_assert(!GBA_LINK_MULTI || gba::GBA_MULTI_TRANSFER_US < GBA_LINK_SAMPLE_MICRO);
+static_assert(GBA_LINK_MULTI || 2 * gba::spi32ExchangeUs(gba::GBA_LINK_RATES[0]) < GBA_LINK_SAMPLE_MICRO);
 
 // MUST BE DEFINED for mpgs
 uint32_t getMillis() {
@@ -86,6 +98,16 @@ static KeyboardReport keyboardReport
 	.keycode = { 0 }
 };
 
+#if GAMEPAD_CORE1_INPUT
+// Core1 acquisition (see `Gamepad::acquire()`): core0's default alarm pool takes hardware alarm 3
+static const uint ACQUISITION_HARDWARE_ALARM = 2;
+
+// Registered by `setup()` on core0, before core1 starts its timer
+static Gamepad * acquiredGamepads[GBA_LINK_PLAYERS];
+static uint32_t acquiredCount = 0;
+static repeating_timer_t acquisitionTimer;
+#endif
+
 void Gamepad::setup()
 {
 	//load(); // MPGS loads
@@ -123,8 +145,22 @@ void Gamepad::setup()
 		mapButtonA1, mapButtonA2
 	};
 
-	// Enable SPI 0 at 1 MHz and connect to GPIOs
-	gba::initSpi32();
+#if GAMEPAD_CORE1_INPUT
+	acquiredGamepads[acquiredCount++] = this;
+#endif
+
+#if GBA_LINK_MULTI
+	// Look for the GBAs, and send them our program via multiboot, while USB comes up (see `stepGBALink()`)
+	if (gbaPlayer == 0)
+		gbaLoader.begin(gbaImage);
+#else
+	// The program picked from the library in flash, if one was flashed, otherwise the built-in one
+	gba::getGBALibraryImage(options.gbaRom, gbaImage);
+
+	// Look for the GBA on our own link port, and send it our program via multiboot, while USB comes up (see `stepGBALink()`)
+	gbaLink = new gba::Spi32Link(gba::GBA_SPI32_PORTS[gbaPlayer]);
+	gbaLoader.begin(gbaImage, *gbaLink);
+#endif
 
 	hotkeyF1Up    =	options.hotkeyF1Up;
 	hotkeyF1Down  =	options.hotkeyF1Down;
@@ -177,39 +213,189 @@ void Gamepad::process()
 	}
 }
 
-void Gamepad::read()
+void Gamepad::setGBARom(const gba::MultibootImage& image)
 {
-	constexpr uint32_t GBA_SPI_ERROR = 0xFFFFFFFFu;
-
-	uint32_t received = gba::spi32(state.buttons);
-
-	if (received == GBA_SPI_ERROR) {
-		state.dpad = 0;
-		state.buttons = 0;
-	} else {
-		state.dpad = 0
-			| ((received & GBAKey::UP)    ? mapDpadUp->buttonMask : 0)
-			| ((received & GBAKey::DOWN)  ? mapDpadDown->buttonMask : 0)
-			| ((received & GBAKey::LEFT)  ? mapDpadLeft->buttonMask  : 0)
-			| ((received & GBAKey::RIGHT) ? mapDpadRight->buttonMask : 0)
-		;
-
-		state.buttons = 0
-			| ((received & GBAKey::B)      ? mapButtonB1->buttonMask  : 0)
-			| ((received & GBAKey::A)      ? mapButtonB2->buttonMask  : 0)
-			| ((received & GBAKey::L)      ? mapButtonL1->buttonMask  : 0)
-			| ((received & GBAKey::R)      ? mapButtonR1->buttonMask  : 0)
-			| ((received & GBAKey::SELECT) ? mapButtonS1->buttonMask  : 0)
-			| ((received & GBAKey::START)  ? mapButtonS2->buttonMask  : 0)
-		;
+	gbaImage = image;
+}
+
+bool Gamepad::stepGBALink()
+{
+#if GBA_LINK_MULTI
+	// The whole link is the slot 0 gamepad's
+	if (gbaPlayer != 0)
+		return false;
+
+	// A GBA plugged in after the others waits in its BIOS: pause the others, and send it the program too
+	if (gbaLinkLive && gba::isMultiBiosWaiting()) {
+		gba::stopMultiStream();
+		gbaLoader.begin(gbaImage);
+		gbaLinkLive = false;
+	}
+#endif
+
+	// The stream is up, and the rate probe checks a frame per call
+	if (gbaLinkRate.isProbing()) {
+		if (gbaLinkRate.step() != gba::LinkRateController::Status::DONE)
+			return false;
+
+		gbaLinkLive = true;
+		return true;
 	}
 
-	state.lx = GAMEPAD_JOYSTICK_MID;
-	state.ly = GAMEPAD_JOYSTICK_MID;
-	state.rx = GAMEPAD_JOYSTICK_MID;
-	state.ry = GAMEPAD_JOYSTICK_MID;
-	state.lt = 0;
-	state.rt = 0;
+	if (gbaLinkLive) {
+#if !GBA_LINK_PUSH && !GBA_LINK_MULTI
+		// The rate changes here, on core0 with the stream timer, even when core1 reads the link
+		gbaLinkRate.update(gbaReading.crcErrors, gbaReading.frameCount);
+#endif
+		return false;
+	}
+
+	if (gbaLoader.step() != gba::MultibootLoader::Status::RUNNING)
+		return false;
+
+#if GBA_LINK_MULTI
+	// `0x6200` makes a waiting BIOS answer, and the programs ignore it
+	gba::setMultiStreamTx(0x6200);
+	gba::startMultiStream(GBA_LINK_SAMPLE_MICRO);
+#elif GBA_LINK_PUSH
+	// The GBA sends its keys as soon as they change, we only listen
+	gbaLink->startPush();
+#else
+	// Exchange keys with the GBA in the background, so `read()` never waits on the wire
+	gbaLink->startStream(GBA_LINK_SAMPLE_MICRO);
+	// Then move to the fastest rate the cable handles, over the next calls
+	gbaLinkRate.begin(*gbaLink, GBA_LINK_SAMPLE_MICRO);
+	return false;
+#endif
+
+	gbaLinkLive = true;
+	return true;
+}
+
+uint64_t Gamepad::getGBALinkWakeTime() const
+{
+	// On Multi-Play, a GBA plugged in later shows up in the stream, which `stepGBALink()` checks every cycle
+	if (gbaLinkLive || (GBA_LINK_MULTI && gbaPlayer != 0))
+		return UINT64_MAX;
+
+	if (gbaLinkRate.isProbing())
+		return to_us_since_boot(gbaLinkRate.getWakeTime());
+
+	return to_us_since_boot(gbaLoader.getWakeTime());
+}
+
+const gba::MultibootStats& Gamepad::getGBAStats() const
+{
+	return gbaLoader.getStats();
+}
+
+void Gamepad::read()
+{
+#if GAMEPAD_CORE1_INPUT
+	InputSample sample;
+	input.read(sample);
+	state = sample.state;
+	gbaReading = sample.gba;
+#else
+	gbaReading = readGBA(state);
+#endif
+}
+
+GBAReading Gamepad::readGBA(GamepadState& out)
+{
+	GBAReading reading;
+#if GBA_LINK_MULTI
+	const uint32_t frameCount = gba::multiFrameCount();
+	uint32_t received = gbaDecoder.decode(gba::latestMultiKeyFrame(gbaPlayer), frameCount);
+	reading.frameTime = getMicro(); // the transfers aren't timestamped, but they're never older than a sample
+#else
+	gbaLink->setStreamTx(out.buttons);
+	const uint32_t frameCount = gbaLink->frameCount();
+	uint32_t received = gbaDecoder.decode(gbaLink->latestFrame(), frameCount);
+	reading.frameTime = gbaLink->latestFrameTime();
+#endif
+	reading.keys = received;
+
+	const uint32_t ticks = gbaDecoder.getStateTicks();
+	reading.edgeTime = ticks == gba::KeyFrameDecoder::NO_TICKS ? 0
+		: reading.frameTime - (uint64_t)ticks * gba::GBA_FRAME_TICK_NS / 1000;
+	reading.frameCount = frameCount;
+	reading.crcErrors = gbaDecoder.getCrcErrors();
+
+	out.dpad = 0
+		| ((received & GBAKey::UP)    ? mapDpadUp->buttonMask : 0)
+		| ((received & GBAKey::DOWN)  ? mapDpadDown->buttonMask : 0)
+		| ((received & GBAKey::LEFT)  ? mapDpadLeft->buttonMask  : 0)
+		| ((received & GBAKey::RIGHT) ? mapDpadRight->buttonMask : 0)
+	;
+
+	out.buttons = 0
+		| ((received & GBAKey::B)      ? mapButtonB1->buttonMask  : 0)
+		| ((received & GBAKey::A)      ? mapButtonB2->buttonMask  : 0)
+		| ((received & GBAKey::L)      ? mapButtonL1->buttonMask  : 0)
+		| ((received & GBAKey::R)      ? mapButtonR1->buttonMask  : 0)
+		| ((received & GBAKey::SELECT) ? mapButtonS1->buttonMask  : 0)
+		| ((received & GBAKey::START)  ? mapButtonS2->buttonMask  : 0)
+	;
+
+	out.lx = GAMEPAD_JOYSTICK_MID;
+	out.ly = GAMEPAD_JOYSTICK_MID;
+	out.rx = GAMEPAD_JOYSTICK_MID;
+	out.ry = GAMEPAD_JOYSTICK_MID;
+	out.lt = 0;
+	out.rt = 0;
+
+	return reading;
+}
+
+// Core1 acquisition
+// Core1 samples the GBAs on a timer of its own alarm pool, so its interrupt also cuts through slow core1 add-ons
+// (e.g. the display), and each gamepad hands its samples over to core0 through a seqlock.
+
+#if GAMEPAD_CORE1_INPUT
+void Gamepad::acquire()
+{
+#if !GBA_LINK_MULTI
+	// The link is the loader's, then the rate probe's, until `stepGBALink()` brings it up
+	if (!gbaLinkLive)
+		return;
+#endif
+
+	InputSample sample;
+	sample.gba = readGBA(acquiredState);
+	if (debounceMS > 0)
+		debouncer.debounce(&acquiredState);
+	sample.state = acquiredState;
+	input.publish(sample);
+}
+
+bool Gamepad::onAcquisitionTimer(repeating_timer_t *)
+{
+	for (uint32_t i = 0; i < acquiredCount; i++)
+		acquiredGamepads[i]->acquire();
+
+	return true;
+}
+#endif
+
+void Gamepad::startAcquisition()
+{
+#if GAMEPAD_CORE1_INPUT
+	// The pool's interrupt goes to the core that creates it
+	alarm_pool_t * pool = alarm_pool_create(ACQUISITION_HARDWARE_ALARM, 1);
+	alarm_pool_add_repeating_timer_us(pool, -(int64_t)GBA_LINK_SAMPLE_MICRO, onAcquisitionTimer, nullptr, &acquisitionTimer);
+#endif
+}
+
+void Gamepad::waitForInput()
+{
+#if GAMEPAD_CORE1_INPUT
+	// Two publishes: the one that may be going on, then one that started after the call
+	const uint32_t sequence = input.getSequence();
+	absolute_time_t timeout = make_timeout_time_us(4 * GBA_LINK_SAMPLE_MICRO);
+	while (input.getSequence() - sequence < 4 && !time_reached(timeout))
+		tight_loop_contents();
+#endif
 }
 
 void Gamepad::debounce() {
@@ -617,6 +803,7 @@ GamepadOptions GamepadStorage::getGamepadOptions()
 	    options.hotkeyF2Down = { HOTKEY_F2_DOWN_MASK, HOTKEY_F2_DOWN_ACTION };
 	    options.hotkeyF2Left = { HOTKEY_F2_LEFT_MASK, HOTKEY_F2_LEFT_ACTION };
 	    options.hotkeyF2Right = { HOTKEY_F2_RIGHT_MASK, HOTKEY_F2_RIGHT_ACTION };
+		options.gbaRom = 0;
 		setGamepadOptions(options);
 	}
 
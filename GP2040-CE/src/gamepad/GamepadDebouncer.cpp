@@ -5,28 +5,44 @@
 
 #include "gamepad/GamepadDebouncer.h"
 
+static const uint32_t DPAD_BITS = 4;
+static const uint32_t INPUTS_MASK = (1 << (DPAD_BITS + GAMEPAD_BUTTON_COUNT)) - 1;
+
+GamepadDebouncer::GamepadDebouncer(const uint8_t debounceMS, const uint32_t sampleUs, const bool eager) :
+	debounceMS(debounceMS), eager(eager)
+{
+	const uint32_t maxThreshold = (1 << COUNT_BITS) - 1;
+	const uint32_t samples = (debounceMS * 1000 + sampleUs - 1) / sampleUs;
+
+	threshold = samples < 1 ? 1 : (samples > maxThreshold ? maxThreshold : samples);
+}
+
 void GamepadDebouncer::debounce(GamepadState *state)
 {
-	uint32_t now = getMillis();
+	const uint32_t sample = (state->dpad | (state->buttons << DPAD_BITS)) & INPUTS_MASK;
+	const uint32_t delta = sample ^ debounced;
 
-	for (int i = 0; i < 4; i++)
+	// Count up the inputs that differ, and start the others over
+	uint32_t carry = delta;
+	for (uint32_t i = 0; i < COUNT_BITS; i++)
 	{
-		if ((debounceState.dpad & dpadMasks[i]) != (state->dpad & dpadMasks[i]) && (now - dpadTime[i]) > debounceMS)
-		{
-			debounceState.dpad ^= dpadMasks[i];
-			dpadTime[i] = now;
-		}
+		const uint32_t bit = counts[i];
+		counts[i] = (bit ^ carry) & delta;
+		carry &= bit;
 	}
 
-	for (int i = 0; i < GAMEPAD_BUTTON_COUNT; i++)
-	{
-		if ((debounceState.buttons & buttonMasks[i]) != (state->buttons & buttonMasks[i]) && (now - buttonTime[i]) > debounceMS)
-		{
-			debounceState.buttons ^= buttonMasks[i];
-			buttonTime[i] = now;
-		}
-	}
+	// The inputs whose count is at the threshold
+	uint32_t settled = delta;
+	for (uint32_t i = 0; i < COUNT_BITS; i++)
+		settled &= (threshold & (1 << i)) ? counts[i] : ~counts[i];
+
+	if (eager)
+		settled |= delta & sample;
+
+	debounced ^= settled;
+	for (uint32_t i = 0; i < COUNT_BITS; i++)
+		counts[i] &= ~settled;
 
-	state->dpad = debounceState.dpad;
-	state->buttons = debounceState.buttons;
+	state->dpad = debounced & ((1 << DPAD_BITS) - 1);
+	state->buttons = debounced >> DPAD_BITS;
 }
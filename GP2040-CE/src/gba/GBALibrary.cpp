@@ -0,0 +1,50 @@
+/*
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#include "gba/GBALibrary.h"
+
+namespace gba
+{
+
+const GBALibraryHeader* getGBALibrary() {
+    const GBALibraryHeader* library = (const GBALibraryHeader*)GBA_LIBRARY_ADDRESS;
+
+    // Erased flash reads 0xFF, and an older firmware's code may still be there
+    if (library->magic != GBA_LIBRARY_MAGIC || library->count > GBA_LIBRARY_MAX_ENTRIES)
+        return nullptr;
+
+    return library;
+}
+
+bool getGBALibraryImage(uint32_t index, MultibootImage& image) {
+    const GBALibraryHeader* library = getGBALibrary();
+    if (library == nullptr || index >= library->count)
+        return false;
+
+    const GBALibraryEntry& entry = library->entries[index];
+    const uint32_t regionSize = GBA_LIBRARY_END - GBA_LIBRARY_ADDRESS;
+    if (entry.offset % 4 != 0 || entry.offset > regionSize || entry.size == 0 || entry.size > regionSize - entry.offset)
+        return false;
+
+    image.payload = (const uint8_t*)library + entry.offset;
+    image.payloadSize = entry.size;
+    image.fingerprint = entry.fingerprint;
+    return true;
+}
+
+int32_t findGBALibraryEntry(uint32_t keys) {
+    const GBALibraryHeader* library = getGBALibrary();
+    if (library == nullptr || keys == 0)
+        return -1;
+
+    for (uint32_t i = 0; i < library->count; i++)
+    {
+        if (library->entries[i].keys == keys)
+            return i;
+    }
+
+    return -1;
+}
+
+}
@@ -0,0 +1,98 @@
+/*
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#include "gba/KeyFrameDecoder.h"
+#include "gba/spi32.h"
+
+namespace gba
+{
+
+// A saturated age only says the edge is at least that old
+static uint32_t getEdgeAge(uint32_t edge) {
+	const uint32_t ticks = getKeyEdgeTicks(edge);
+	return ticks < GBA_FRAME_MAX_TICKS ? ticks : KeyFrameDecoder::NO_TICKS;
+}
+
+void KeyFrameDecoder::queue(uint32_t state, uint32_t ticks) {
+	// Nothing to replay if it's what will be reported anyway
+	const uint32_t last = replayCount ? replay[(replayHead + replayCount - 1) % REPLAY_SIZE] : keys;
+	if (state == last)
+		return;
+
+	// Replay can't keep up (e.g. pushed frames faster than the poll), so drop the oldest state
+	if (replayCount == REPLAY_SIZE) {
+		replayHead = (replayHead + 1) % REPLAY_SIZE;
+		replayCount--;
+	}
+
+	const uint32_t slot = (replayHead + replayCount) % REPLAY_SIZE;
+	replay[slot] = state;
+	replayTicks[slot] = ticks;
+	replayFrameCounts[slot] = lastFrameCount;
+	replayCount++;
+}
+
+uint32_t KeyFrameDecoder::decode(uint32_t frame, uint32_t frameCount) {
+	if (frame == GBA_SPI_ERROR) {
+		replayCount = 0;
+		keys = 0;
+		keysTicks = NO_TICKS;
+		hasSeq = false;
+		return keys;
+	}
+
+	if (frameCount != lastFrameCount) {
+		lastFrameCount = frameCount;
+
+		if (!isKeyFrameValid(frame)) {
+			crcErrors++;
+			return next();
+		}
+
+		// Same frame sent twice (e.g. the GBA missed its turn): its edges were already replayed
+		const uint32_t seq = getKeyFrameSeq(frame);
+		if (hasSeq && seq == lastSeq)
+			return next();
+
+		if (hasSeq)
+			skippedFrames += ((seq - lastSeq) & GBA_FRAME_SEQ_MASK) - 1;
+		lastSeq = seq;
+		hasSeq = true;
+
+		const uint32_t current = frame & GBA_FRAME_KEYS_MASK;
+		uint32_t newest = getKeyEdge(frame, 0);
+		uint32_t older = getKeyEdge(frame, 1);
+
+		// Both edges are in the log: the state between them may never have been seen
+		if (isKeyEdge(newest) && isKeyEdge(older)) {
+			if (getKeyEdgeTicks(older) < getKeyEdgeTicks(newest)) {
+				uint32_t tmp = newest;
+				newest = older;
+				older = tmp;
+			}
+
+			const uint32_t between = current ^ getKeyEdgeMask(newest);
+			if (between != current)
+				queue(between, getEdgeAge(older));
+		}
+
+		queue(current, isKeyEdge(newest) ? getEdgeAge(newest) : NO_TICKS);
+	}
+
+	return next();
+}
+
+uint32_t KeyFrameDecoder::next() {
+	if (replayCount) {
+		keys = replay[replayHead];
+		keysTicks = replayTicks[replayHead];
+		keysFrameCount = replayFrameCounts[replayHead];
+		replayHead = (replayHead + 1) % REPLAY_SIZE;
+		replayCount--;
+	}
+
+	return keys;
+}
+
+}
@@ -0,0 +1,114 @@
+/*
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#include "gba/LinkRate.h"
+#include "gba/GBAKeyFrame.h"
+#include "gba/spi32.h"
+
+#include "pico/stdlib.h"
+
+namespace gba
+{
+
+// Probe: frames checked per rate, and how long to wait for them (the GBA program may not answer every poll)
+static constexpr uint32_t RATE_PROBE_FRAMES = 16;
+static constexpr uint32_t RATE_PROBE_MIN_FRAMES = 4;
+static constexpr uint32_t RATE_PROBE_TIMEOUT_MS = 100;
+
+// Runtime: more bad frames than this within a window steps the rate down
+static constexpr uint32_t RATE_WINDOW_FRAMES = 256;
+static constexpr uint32_t RATE_WINDOW_MAX_ERRORS = 4;
+
+void LinkRateController::setRate(uint32_t index) {
+	rateIndex = index;
+	link->setBitrate(GBA_LINK_RATES[rateIndex]);
+	windowStarted = false;
+}
+
+void LinkRateController::begin(Spi32Link& link, uint32_t frameUs) {
+	this->link = &link;
+	this->frameUs = frameUs;
+	bestIndex = -1;
+	probing = true;
+	startProbeRate(0);
+}
+
+void LinkRateController::startProbeRate(uint32_t index) {
+	setRate(index);
+
+	// Skip the frame that was on the wire during the change
+	seenFrames = link->frameCount();
+	skippedFrame = seenFrames + 1;
+	goodFrames = 0;
+	badFrames = 0;
+	rateTimeout = make_timeout_time_ms(RATE_PROBE_TIMEOUT_MS);
+	wakeTime = get_absolute_time();
+}
+
+void LinkRateController::finishProbe() {
+	probing = false;
+	setRate(bestIndex < 0 ? GBA_LINK_DEFAULT_RATE_INDEX : bestIndex);
+}
+
+LinkRateController::Status LinkRateController::step() {
+	if (!probing)
+		return Status::DONE;
+
+	// Only the latest frame can be checked, so the frames a late step missed aren't counted
+	const uint32_t count = link->frameCount();
+	if (count != seenFrames) {
+		if (count != skippedFrame) {
+			if (isKeyFrameValid(link->latestFrame()))
+				goodFrames++;
+			else
+				badFrames++;
+		}
+		seenFrames = count;
+	}
+
+	if (goodFrames + badFrames < RATE_PROBE_FRAMES && !time_reached(rateTimeout)) {
+		// Twice a frame, so a step doesn't miss one
+		wakeTime = make_timeout_time_us(frameUs / 2);
+		return Status::PROBING;
+	}
+
+	// Faster rates won't do better on this cable
+	if (badFrames > 0 || goodFrames < RATE_PROBE_MIN_FRAMES) {
+		finishProbe();
+		return Status::DONE;
+	}
+
+	bestIndex = rateIndex;
+	if (rateIndex + 1 == GBA_LINK_RATE_COUNT) {
+		finishProbe();
+		return Status::DONE;
+	}
+
+	startProbeRate(rateIndex + 1);
+	return Status::PROBING;
+}
+
+void LinkRateController::update(uint32_t crcErrors, uint32_t frameCount) {
+	// Not probed yet, so there's no stream to tune
+	if (!link || probing)
+		return;
+
+	if (!windowStarted) {
+		windowFrames = frameCount;
+		windowErrors = crcErrors;
+		windowStarted = true;
+		return;
+	}
+
+	if (crcErrors - windowErrors > RATE_WINDOW_MAX_ERRORS) {
+		if (rateIndex > 0)
+			setRate(rateIndex - 1);
+		else
+			windowStarted = false;
+	} else if (frameCount - windowFrames >= RATE_WINDOW_FRAMES) {
+		windowStarted = false;
+	}
+}
+
+}
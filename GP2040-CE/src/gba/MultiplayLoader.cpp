@@ -0,0 +1,392 @@
+/*
+ * SPDX-License-Identifier: CC0-1.0
+ *
+ * Multi-Play multiboot, following `LinkCableMultiboot` and the BIOS `MultiBoot` call it ends with.
+ */
+
+#include "gba/MultiplayLoader.h"
+
+#include "pico/stdlib.h"
+
+#include "gba/GBAKeyFrame.h"
+#include "gba/MultibootCrc.h"
+
+namespace gba
+{
+
+// `LinkCableMultiboot` waits 50 scanlines before each transfer
+static constexpr uint32_t GBA_MULTI_GAP_US = 50 * 73433 / 1000;
+// Between `0x6200` while looking for GBAs, and between checksum polls
+static constexpr uint32_t GBA_DETECT_GAP_US = 10000;
+static constexpr uint32_t GBA_DETECT_TRIES = 16;
+// The BIOS wants 1/16 s between the handshake and the length
+static constexpr uint32_t GBA_HANDSHAKE_WAIT_US = 1000000 / 16;
+// ROM halfwords are only copied by the BIOS, a transfer takes longer than that
+static constexpr uint32_t GBA_BODY_GAP_US = 0;
+static constexpr uint32_t GBA_CHECKSUM_TRIES = 200;
+// Same retries and backoff as Normal mode (see `multiboot.cpp`)
+static constexpr uint32_t GBA_HEADER_RETRIES = 3;
+static constexpr uint32_t GBA_SEED_TRIES = 16;
+static constexpr uint32_t GBA_BACKOFF_MAX_US = 2 * 1000 * 1000;
+static constexpr uint32_t GBA_BACKOFF_MAX_SHIFT = 8;
+
+static constexpr uint32_t GBA_HEADER_SIZE = 0xC0;
+static constexpr uint8_t GBA_PALETTE_DATA = 0x93;
+static constexpr uint8_t GBA_CLIENT_NO_DATA = 0xFF;
+
+using MultiCrc = MultibootCrc<0xa1c1>;
+
+/// Folds the ROM word at `i` into the CRC, and encrypts it for the wire
+static uint32_t encodeWord(uint32_t dat, uint32_t i, uint32_t& crc, uint32_t& seed) {
+    crc = MultiCrc::update(crc, dat);
+
+    seed = seed * 0x6F646573 + 1;
+    return seed ^ dat ^ (0xFE000000 - i) ^ 0x6465646F;
+}
+
+void MultiplayLoader::begin(const MultibootImage& image) {
+    this->image = image;
+    failures = 0;
+    getMultibootStats();
+
+    initMulti();
+    restart();
+}
+
+MultiplayLoader::Status MultiplayLoader::step() {
+    const absolute_time_t stepEnd = make_timeout_time_us(GBA_MULTIBOOT_STEP_US);
+
+    while (stage != Stage::RUNNING)
+    {
+        // Short gaps are waited out here, longer ones are left to the following steps
+        if (absolute_time_diff_us(stepEnd, wakeTime) > 0)
+            break;
+
+        while (!time_reached(wakeTime))
+            tight_loop_contents();
+
+        advance();
+    }
+
+    return stage == Stage::RUNNING ? Status::RUNNING : Status::BUSY;
+}
+
+const MultibootStats& MultiplayLoader::getStats() const {
+    return getMultibootStats();
+}
+
+void MultiplayLoader::wait(uint32_t us) {
+    wakeTime = make_timeout_time_us(us);
+}
+
+void MultiplayLoader::restart() {
+    stage = Stage::DETECT;
+    index = 0;
+    tries = 0;
+    headerTries = 0;
+    clientBits = 0;
+    runningBits = 0;
+    wakeTime = get_absolute_time();
+}
+
+void MultiplayLoader::fail() {
+    restart();
+
+    const uint32_t backoffUs = GBA_DETECT_GAP_US << (failures < GBA_BACKOFF_MAX_SHIFT ? failures : GBA_BACKOFF_MAX_SHIFT);
+    wait(backoffUs < GBA_BACKOFF_MAX_US ? backoffUs : GBA_BACKOFF_MAX_US);
+    failures++;
+}
+
+void MultiplayLoader::succeed() {
+    getMultibootStats().uploads++;
+    failures = 0;
+
+    // Wait for the program to answer, the BIOS plays its logo first
+    restart();
+    wait(GBA_DETECT_GAP_US);
+}
+
+void MultiplayLoader::rejectHeader() {
+    getMultibootStats().headerErrors++;
+
+    if (++headerTries == GBA_HEADER_RETRIES)
+    {
+        fail();
+        return;
+    }
+
+    // The BIOS goes back to waiting for `0x6200`, so send the header again from there
+    const uint32_t keepTries = headerTries;
+    restart();
+    headerTries = keepTries;
+    wait(GBA_DETECT_GAP_US);
+}
+
+bool MultiplayLoader::allAnswered(const uint16_t recv[GBA_MULTI_CLIENTS], uint16_t expected) const {
+    for (uint32_t i = 0; i < GBA_MULTI_CLIENTS; i++)
+    {
+        const uint16_t id = GBA_MULTI_CLIENT_IDS[i];
+        if ((clientBits & id) && recv[i] != (expected | id))
+            return false;
+    }
+
+    return true;
+}
+
+bool MultiplayLoader::allEqual(const uint16_t recv[GBA_MULTI_CLIENTS], uint16_t value) const {
+    for (uint32_t i = 0; i < GBA_MULTI_CLIENTS; i++)
+    {
+        if ((clientBits & GBA_MULTI_CLIENT_IDS[i]) && recv[i] != value)
+            return false;
+    }
+
+    return true;
+}
+
+void MultiplayLoader::advance() {
+    uint16_t recv[GBA_MULTI_CLIENTS];
+
+    switch (stage)
+    {
+        case Stage::DETECT:
+        {
+            multiExchange(0x6200, recv);
+            wait(GBA_DETECT_GAP_US);
+
+            for (uint32_t i = 0; i < GBA_MULTI_CLIENTS; i++)
+            {
+                const uint16_t id = GBA_MULTI_CLIENT_IDS[i];
+                if (recv[i] == (0x7200 | id))
+                    clientBits |= id;
+                else if (isMultiKeyFrameValid(recv[i]))
+                    runningBits |= id;
+            }
+
+            if (++index < GBA_DETECT_TRIES)
+                break;
+
+            if (clientBits)
+            {
+                stage = Stage::CONFIRM;
+                wait(GBA_MULTI_GAP_US);
+            }
+            else if (runningBits)
+                stage = Stage::RUNNING;
+            else
+            {
+                // Nobody there yet
+                index = 0;
+                runningBits = 0;
+            }
+            break;
+        }
+
+        case Stage::CONFIRM:
+        {
+            multiExchange(0x6100 | clientBits, recv);
+            wait(GBA_MULTI_GAP_US);
+
+            if (!allAnswered(recv, 0x7200))
+            {
+                rejectHeader();
+                break;
+            }
+
+            stage = Stage::HEADER;
+            index = 0;
+            break;
+        }
+
+        case Stage::HEADER:
+        {
+            const uint16_t* fdata16 = (const uint16_t*)image.rom;
+
+            multiExchange(fdata16[index], recv);
+            wait(GBA_MULTI_GAP_US);
+
+            if (++index == GBA_HEADER_SIZE / 2)
+                stage = Stage::CONFIRM_HEADER;
+            break;
+        }
+
+        case Stage::CONFIRM_HEADER:
+        case Stage::RECONFIRM:
+        {
+            // Answers `0x000x` right after the header, then `0x720x` once the BIOS took it
+            multiExchange(0x6200, recv);
+            wait(GBA_MULTI_GAP_US);
+
+            const bool confirm = stage == Stage::CONFIRM_HEADER;
+            if (!allAnswered(recv, confirm ? 0x0000 : 0x7200))
+            {
+                rejectHeader();
+                break;
+            }
+
+            stage = confirm ? Stage::RECONFIRM : Stage::PALETTE;
+            tries = 0;
+            for (uint32_t i = 0; i < GBA_MULTI_CLIENTS; i++)
+                clientData[i] = GBA_CLIENT_NO_DATA;
+            break;
+        }
+
+        case Stage::PALETTE:
+        {
+            // Each BIOS answers `0x73cc` with its seed byte, once it's ready
+            multiExchange(0x6300 | GBA_PALETTE_DATA, recv);
+            wait(GBA_MULTI_GAP_US);
+
+            bool ready = true;
+            for (uint32_t i = 0; i < GBA_MULTI_CLIENTS; i++)
+            {
+                if (!(clientBits & GBA_MULTI_CLIENT_IDS[i]))
+                    continue;
+
+                if ((recv[i] >> 8) == 0x73)
+                    clientData[i] = recv[i] & 0xFF;
+                if (clientData[i] == GBA_CLIENT_NO_DATA)
+                    ready = false;
+            }
+
+            if (ready)
+            {
+                stage = Stage::HANDSHAKE;
+                break;
+            }
+
+            if (++tries == GBA_SEED_TRIES)
+            {
+                getMultibootStats().seedErrors++;
+                fail();
+            }
+            break;
+        }
+
+        case Stage::HANDSHAKE:
+        {
+            handshakeData = (0x11 + clientData[0] + clientData[1] + clientData[2]) & 0xFF;
+
+            multiExchange(0x6400 | handshakeData, recv);
+
+            for (uint32_t i = 0; i < GBA_MULTI_CLIENTS; i++)
+            {
+                if ((clientBits & GBA_MULTI_CLIENT_IDS[i]) && (recv[i] >> 8) != 0x73)
+                {
+                    getMultibootStats().seedErrors++;
+                    fail();
+                    return;
+                }
+            }
+
+            stage = Stage::LENGTH;
+            wait(GBA_HANDSHAKE_WAIT_US);
+            break;
+        }
+
+        case Stage::LENGTH:
+        {
+            fsize = (image.romSize + 0xF) & ~0xF;
+
+            // Each BIOS answers `0x73rr` with its final CRC byte
+            multiExchange((fsize - 0x190) / 4, recv);
+            wait(GBA_MULTI_GAP_US);
+
+            finalWord = handshakeData;
+            seed = GBA_PALETTE_DATA;
+            for (uint32_t i = 0; i < GBA_MULTI_CLIENTS; i++)
+            {
+                const bool connected = clientBits & GBA_MULTI_CLIENT_IDS[i];
+                const uint32_t crcByte = connected ? recv[i] & 0xFF : GBA_CLIENT_NO_DATA;
+
+                if (connected && (recv[i] >> 8) != 0x73)
+                {
+                    getMultibootStats().seedErrors++;
+                    fail();
+                    return;
+                }
+
+                finalWord |= crcByte << (8 * (i + 1));
+                seed |= (uint32_t)clientData[i] << (8 * (i + 1));
+            }
+
+            crc = 0xFFF8;
+            stage = Stage::BODY;
+            index = GBA_HEADER_SIZE;
+            break;
+        }
+
+        case Stage::BODY:
+        {
+            // Each encrypted word goes as two halfwords, low one first.
+            // The BIOS keeps whatever comes, so a garbled one only shows in the CRC.
+            const uint32_t* fdata32 = (const uint32_t*)image.rom;
+
+            if (index % 4 == 0)
+                dat = index < image.romSize ? encodeWord(fdata32[index / 4], index, crc, seed)
+                                            : encodeWord(0, index, crc, seed); // padding to 16 bytes
+
+            multiExchange(index % 4 == 0 ? dat & 0xFFFF : dat >> 16, recv);
+            wait(GBA_BODY_GAP_US);
+
+            index += 2;
+            if (index >= fsize)
+            {
+                crc = MultiCrc::update(crc, finalWord);
+
+                stage = Stage::CHECKSUM;
+                index = 0;
+                tries = 0;
+                wait(GBA_MULTI_GAP_US);
+            }
+            break;
+        }
+
+        case Stage::CHECKSUM:
+        {
+            wait(GBA_MULTI_GAP_US);
+
+            switch (index)
+            {
+                case 0:
+                    multiExchange(0x0065, recv);
+                    if (allEqual(recv, 0x0075))
+                        index++;
+                    else if (++tries == GBA_CHECKSUM_TRIES)
+                    {
+                        getMultibootStats().crcErrors++;
+                        fail();
+                    }
+                    else
+                        wait(GBA_MULTI_GAP_US + GBA_DETECT_GAP_US);
+                    break;
+
+                case 1:
+                    multiExchange(0x0066, recv);
+                    index++;
+                    break;
+
+                default:
+                {
+                    multiExchange(crc & 0xFFFF, recv);
+
+                    // Each BIOS answers its own CRC, and drops the program if it doesn't match
+                    if (!allEqual(recv, crc & 0xFFFF))
+                    {
+                        getMultibootStats().crcErrors++;
+                        fail();
+                        break;
+                    }
+
+                    succeed();
+                    break;
+                }
+            }
+            break;
+        }
+
+        case Stage::RUNNING:
+            break;
+    }
+}
+
+}
@@ -7,149 +7,515 @@
 
 #include "gba/multiboot.h"
 
-#include <cstdlib>
 #include "pico/stdlib.h"
 
+#include "persistentstats.h"
 #include "gba/spi32.h"
-#include "gba/GBAKey.h"
+#include "gba/GBAKeyFrame.h"
+#include "gba/GBALoader.h"
+#include "gba/MultibootCrc.h"
 
 namespace gba
 {
 
-static constexpr int GBA_DELAY_MS = 3;
-
-uint32_t spi32Delay(uint32_t val) {
-    uint32_t result = gba::spi32(val);
-    sleep_ms(GBA_DELAY_MS);
-
-    return result;
+// Handshake words, where the BIOS has real work to do before answering
+static constexpr uint32_t GBA_DELAY_US = 3000;
+// Header halfwords are only copied by the BIOS
+static constexpr uint32_t GBA_HEADER_GAP_US = 100;
+// Between `0x6202` while looking for the GBA, and between checksum polls
+static constexpr uint32_t GBA_DETECT_GAP_US = 10000;
+// Push mode: `0x6202` tries before listening for a running program again
+static constexpr uint32_t GBA_DETECT_TRIES = 10;
+static constexpr uint32_t GBA_CHECKSUM_TRIES = 200;
+// Fingerprint queries before a running program that never matches is reset
+static constexpr uint32_t GBA_QUERY_TRIES = 8;
+static constexpr uint32_t GBA_RESET_TRIES = 3;
+// How long the loader stub may take to answer after the upload, in `GBA_DETECT_GAP_US`
+static constexpr uint32_t GBA_LOADER_TRIES = 500;
+// Header rejections before the upload counts as failed
+static constexpr uint32_t GBA_HEADER_RETRIES = 3;
+// `0x63D1` until the BIOS answers with its seed token
+static constexpr uint32_t GBA_SEED_TRIES = 16;
+
+// Failed uploads back off from `GBA_DETECT_GAP_US`, doubling up to this, and keep trying
+static constexpr uint32_t GBA_BACKOFF_MAX_US = 2 * 1000 * 1000;
+static constexpr uint32_t GBA_BACKOFF_MAX_SHIFT = 8;
+
+// ROM body pacing: the BIOS echoes the offset of each word it took, so the gap between words
+// only grows when it wasn't ready yet, and shrinks back while it keeps up
+static constexpr uint32_t GBA_GAP_MIN_US = 16;
+static constexpr uint32_t GBA_GAP_MAX_US = GBA_DELAY_US;
+static constexpr uint32_t GBA_WORD_RETRIES = 8;
+
+static constexpr uint32_t GBA_HEADER_SIZE = 0xC0;
+
+static constexpr uint32_t GBA_STATS_MAGIC = 0x47424153; // "GBAS"
+
+static PersistentStats<MultibootStats, GBA_STATS_MAGIC> __uninitialized_ram(persistentStats);
+
+MultibootStats& getMultibootStats() {
+    return persistentStats.get();
 }
 
-bool sendGBARom(const uint8_t* romAddr, const uint32_t romSize) {
-    initSpi32();
-
-    uint32_t recv;
-    uint32_t fsize = romSize;
+using NormalCrc = MultibootCrc<0xc37b>;
 
-    // -----------------------------------------------------
-    // printf("Waiting for GBA...\n");
-    
-    do {
-        recv = gba::spi32(0x6202);
-        sleep_ms(10);
-    } while ((recv >> 16) != 0x7202 && recv != (GBAKey::START));
+/// Folds the ROM word at `i` into the CRC, and encrypts it for the wire
+static uint32_t encodeWord(uint32_t dat, uint32_t i, uint32_t& crc, uint32_t& seed) {
+    crc = NormalCrc::update(crc, dat);
 
-    // if GBA program is already running, and only `Start` is pressed on it
-    if (recv == (GBAKey::START))
-        return false;
-    
-    // -----------------------------------------------------
-    // printf("Sending header.\n");
-
-    spi32Delay(0x6102);
+    seed = seed * 0x6F646573 + 1;
+    return seed ^ dat ^ (0xFE000000 - i) ^ 0x43202F2F;
+}
 
-    const uint16_t* fdata16 = (const uint16_t*)romAddr;
-    for (uint32_t i = 0; i < 0xC0; i += 2)
-        spi32Delay(fdata16[i / 2]);
+void MultibootLoader::begin(const MultibootImage& image, Spi32Link& link) {
+    this->image = image;
+    this->link = &link;
+    failures = 0;
+    getMultibootStats();
 
-    spi32Delay(0x6200);
+#if !GBA_LINK_PUSH
+    link.init();
+#endif
+    restart();
+}
 
-    // -----------------------------------------------------
-    // printf("Getting encryption and crc seeds.\n");
+MultibootLoader::Status MultibootLoader::step() {
+    const absolute_time_t stepEnd = make_timeout_time_us(GBA_MULTIBOOT_STEP_US);
 
-    spi32Delay(0x6202);
-    spi32Delay(0x63D1);
+    while (stage != Stage::RUNNING)
+    {
+        // Short gaps are waited out here, longer ones are left to the following steps
+        if (absolute_time_diff_us(stepEnd, wakeTime) > 0)
+            break;
 
-    uint32_t token = spi32Delay(0x63D1);
+        while (!time_reached(wakeTime))
+            tight_loop_contents();
 
-    if ((token >> 24) != 0x73)
-    {
-        // fprintf(stderr, "Failed handshake!\n");
-        exit(1);
+        advance();
     }
 
+    return stage == Stage::RUNNING ? Status::RUNNING : Status::BUSY;
+}
 
-    uint32_t crcA, crcB, crcC, seed;
+const MultibootStats& MultibootLoader::getStats() const {
+    return persistentStats.stats;
+}
 
-    crcA = (token >> 16) & 0xFF;
-    seed = 0xFFFF00D1 | (crcA << 8);
-    crcA = (crcA + 0xF) & 0xFF;
+void MultibootLoader::wait(uint32_t us) {
+    wakeTime = make_timeout_time_us(us);
+}
 
-    spi32Delay(0x6400 | crcA);
+void MultibootLoader::restart() {
+    index = 0;
+    tries = 0;
+    headerTries = 0;
+    hasFrame = false;
+    wakeTime = get_absolute_time();
+
+#if GBA_LINK_PUSH
+    // A running push-mode program is the link master, so listen before clocking anything on SC
+    stage = Stage::LISTEN;
+#else
+    stage = Stage::DETECT;
+#endif
+}
 
-    fsize += 0xF;
-    fsize &= ~0xF;
+void MultibootLoader::fail() {
+    // printf("Upload failed, starting over.\n");
+#if GBA_LINK_PUSH
+    link->deinit();
+#endif
+    restart();
+
+    // A flaky cable or a GBA being plugged in can fail many in a row, but a later one may still go through
+    const uint32_t backoffUs = GBA_DETECT_GAP_US << (failures < GBA_BACKOFF_MAX_SHIFT ? failures : GBA_BACKOFF_MAX_SHIFT);
+    wait(backoffUs < GBA_BACKOFF_MAX_US ? backoffUs : GBA_BACKOFF_MAX_US);
+    failures++;
+}
 
-    token = spi32Delay((fsize - 0x190) / 4);
-    crcB = (token >> 16) & 0xFF;
-    crcC = 0xC387;
+void MultibootLoader::succeed() {
+    persistentStats.stats.uploads++;
+    failures = 0;
 
-    // -----------------------------------------------------
-    // printf("Sending...\n");
-    
-    const uint32_t* fdata32 = (const uint32_t*)romAddr;
+    // Wait for the program to answer, the BIOS plays its logo first
+#if GBA_LINK_PUSH
+    link->deinit();
+#endif
+    restart();
+    wait(GBA_DETECT_GAP_US);
+}
 
-    for (uint32_t i = 0xC0; i < fsize; i += 4)
+void MultibootLoader::advance() {
+    switch (stage)
     {
-        uint32_t dat = fdata32[i / 4];
+        case Stage::LISTEN:
+        {
+            if (index == 0)
+            {
+                link->startPush(0);
+                index = 1;
+                wait(GBA_PUSH_TIMEOUT_US);
+                break;
+            }
+
+            if (isKeyFrameValid(link->latestFrame()))
+            {
+                // Keep listening, the gamepad takes it from here
+                stage = Stage::RUNNING;
+                break;
+            }
+
+            link->stopPush();
+            link->init();
+            stage = Stage::DETECT;
+            index = 0;
+            tries = 0;
+            break;
+        }
 
-        // crc step
-        uint32_t tmp = dat;
+        case Stage::DETECT:
+        {
+            // printf("Waiting for GBA...\n");
+            const uint32_t recv = link->exchange(0x6202);
+            wait(GBA_DETECT_GAP_US);
+
+            if ((recv >> 16) == 0x7202)
+            {
+                stage = Stage::HEADER;
+                index = 0;
+                break;
+            }
+
+#if !GBA_LINK_PUSH
+            // The program answers with key frames: ask it which one it is
+            if (isKeyFrameValid(recv))
+            {
+                stage = Stage::QUERY;
+                index = 0;
+                hasFrame = false;
+                break;
+            }
+#endif
+
+#if GBA_LINK_PUSH
+            if (++tries == GBA_DETECT_TRIES)
+            {
+                link->deinit();
+                stage = Stage::LISTEN;
+                index = 0;
+            }
+#endif
+            break;
+        }
 
-        for (uint32_t b = 0; b < 32; b++)
+        case Stage::QUERY:
         {
-            uint32_t bit = (crcC ^ tmp) & 1;
+            // The answer to a query comes on the following exchange, so the first one is a key frame
+            const uint32_t recv = link->exchange(GBA_QUERY_FINGERPRINT);
+            wait(GBA_DETECT_GAP_US);
+
+            if (index > 0 && recv == image.fingerprint)
+            {
+                stage = Stage::RUNNING;
+                break;
+            }
+
+            hasFrame = hasFrame || isKeyFrameValid(recv);
+
+            if (++index == GBA_QUERY_TRIES)
+            {
+                // Still answering key frames, but not ours (e.g. the firmware was updated): make room for ours.
+                // Otherwise it was line noise, or it's gone.
+                stage = hasFrame ? Stage::RESET : Stage::DETECT;
+                index = 0;
+            }
+            break;
+        }
 
-            crcC = (crcC >> 1) ^ (bit ? 0xc37b : 0);
-            tmp >>= 1;
+        case Stage::RESET:
+        {
+            // The BIOS answers `0x6202` again after its boot logo
+            link->exchange(GBA_QUERY_RESET);
+            wait(GBA_DETECT_GAP_US);
+
+            if (++index == GBA_RESET_TRIES)
+            {
+                stage = Stage::DETECT;
+                index = 0;
+            }
+            break;
         }
 
-        // encrypt step
-        seed = seed * 0x6F646573 + 1;
-        dat = seed ^ dat ^ (0xFE000000 - i) ^ 0x43202F2F;
+        case Stage::HEADER:
+        {
+            // printf("Sending header.\n");
+            const uint16_t* fdata16 = (const uint16_t*)image.rom;
+
+            if (index == 0)
+            {
+                link->exchange(0x6102);
+                wait(GBA_DELAY_US);
+            }
+            else if (index <= GBA_HEADER_SIZE / 2)
+            {
+                link->exchange(fdata16[index - 1]);
+                wait(GBA_HEADER_GAP_US);
+            }
+            else
+            {
+                link->exchange(0x6200);
+                wait(GBA_DELAY_US);
+                stage = Stage::HANDSHAKE;
+                index = 0;
+                break;
+            }
+
+            index++;
+            break;
+        }
 
-        // send
-        uint32_t chk = spi32Delay(dat) >> 16;
+        case Stage::HANDSHAKE:
+        {
+            // printf("Getting encryption and crc seeds.\n");
+            wait(GBA_DELAY_US);
+
+            switch (index++)
+            {
+                case 0:
+                    link->exchange(0x6202);
+                    break;
+
+                case 1:
+                {
+                    // Answers `0x72xx` once the BIOS took the header, or already the seed token
+                    const uint32_t recv = link->exchange(0x63D1) >> 24;
+
+                    if (recv != 0x72 && recv != 0x73)
+                    {
+                        persistentStats.stats.headerErrors++;
+
+                        if (++headerTries == GBA_HEADER_RETRIES)
+                        {
+                            fail();
+                            break;
+                        }
+
+                        // The BIOS goes back to waiting for `0x6202`, so send the header again from there
+                        stage = Stage::DETECT;
+                        index = 0;
+                        tries = 0;
+                        wait(GBA_DETECT_GAP_US);
+                    }
+                    break;
+                }
+
+                case 2:
+                {
+                    const uint32_t token = link->exchange(0x63D1);
+
+                    if ((token >> 24) != 0x73)
+                    {
+                        // Not ready yet: the BIOS keeps answering `0x63D1` until it is
+                        if (++tries == GBA_SEED_TRIES)
+                        {
+                            // fprintf(stderr, "Failed handshake!\n");
+                            persistentStats.stats.seedErrors++;
+                            fail();
+                            break;
+                        }
+
+                        index = 2;
+                        break;
+                    }
+
+                    tries = 0;
+
+                    crcA = (token >> 16) & 0xFF;
+                    seed = 0xFFFF00D1 | (crcA << 8);
+                    crcA = (crcA + 0xF) & 0xFF;
+                    break;
+                }
+
+                case 3:
+                    link->exchange(0x6400 | crcA);
+                    break;
+
+                default:
+                {
+                    fsize = (image.romSize + 0xF) & ~0xF;
+
+                    const uint32_t token = link->exchange((fsize - 0x190) / 4);
+                    crcB = (token >> 16) & 0xFF;
+                    crcC = 0xC387;
+
+                    // printf("Sending...\n");
+                    // The next word is encoded while the current one is on the wire
+                    const uint32_t* fdata32 = (const uint32_t*)image.rom;
+                    dat = encodeWord(fdata32[GBA_HEADER_SIZE / 4], GBA_HEADER_SIZE, crcC, seed);
+                    gapUs = GBA_GAP_MIN_US;
+                    resend = false;
+                    tries = 0;
+
+                    stage = Stage::BODY;
+                    index = GBA_HEADER_SIZE;
+                    break;
+                }
+            }
+            break;
+        }
 
-        if (chk != (i & 0xFFFF))
+        case Stage::BODY:
         {
-            // fprintf(stderr, "Transmission error at byte %zu: chk == %08x\n", i, chk);
-            exit(1);
+            const uint32_t* fdata32 = (const uint32_t*)image.rom;
+
+            link->put(dat);
+            if (!resend)
+                next = index + 4 < fsize ? encodeWord(fdata32[(index + 4) / 4], index + 4, crcC, seed) : 0;
+            const uint32_t chk = link->get() >> 16;
+
+            if (chk != (index & 0xFFFF))
+            {
+                if (++tries > GBA_WORD_RETRIES)
+                {
+                    // fprintf(stderr, "Transmission error at byte %zu\n", index);
+                    // The encryption has moved on with the words sent so far, so only a new upload gets back in sync
+                    persistentStats.stats.bodyErrors++;
+                    persistentStats.stats.bodyOffset = index;
+                    fail();
+                    break;
+                }
+
+                // Not armed yet, so the word wasn't taken: back off and send it again
+                resend = true;
+                gapUs = gapUs * 2 < GBA_GAP_MAX_US ? gapUs * 2 : GBA_GAP_MAX_US;
+                wait(gapUs);
+                break;
+            }
+
+            resend = false;
+            tries = 0;
+            gapUs -= (gapUs - GBA_GAP_MIN_US) / 8;
+            wait(gapUs);
+
+            dat = next;
+            index += 4;
+
+            if (index >= fsize)
+            {
+                // crc step final
+                crcC = NormalCrc::update(crcC, 0xFFFF0000 | (crcB << 8) | crcA);
+
+                stage = Stage::CHECKSUM;
+                index = 0;
+            }
+            break;
         }
-    }
 
-    // crc step final
-    uint32_t tmp = 0xFFFF0000 | (crcB << 8) | crcA;
+        case Stage::CHECKSUM:
+        {
+            // printf("Waiting for checksum...\n");
+            wait(GBA_DELAY_US);
+
+            switch (index)
+            {
+                case 0:
+                    link->exchange(0x0065);
+                    index++;
+                    break;
+
+                case 1:
+                    if ((link->exchange(0x0065) >> 16) == 0x0075)
+                    {
+                        index++;
+                        tries = 0;
+                    }
+                    else if (++tries == GBA_CHECKSUM_TRIES)
+                    {
+                        persistentStats.stats.crcErrors++;
+                        fail();
+                    }
+                    else
+                        wait(GBA_DELAY_US + GBA_DETECT_GAP_US);
+                    break;
+
+                case 2:
+                    link->exchange(0x0066);
+                    index++;
+                    break;
+
+                default:
+                {
+                    uint32_t crcGBA = link->exchange(crcC & 0xFFFF) >> 16;
+
+                    // printf("Gba: %x, Cal: %x\n", crcGBA, crcC);
+                    if (crcGBA != (crcC & 0xFFFF))
+                    {
+                        // The BIOS drops the program and waits for a new upload
+                        persistentStats.stats.crcErrors++;
+                        fail();
+                        break;
+                    }
+
+                    // printf("Done.\n");
+                    if (image.payload)
+                    {
+                        stage = Stage::PAYLOAD;
+                        index = 0;
+                        tries = 0;
+                        gapUs = GBA_GAP_MIN_US;
+                        wait(GBA_DETECT_GAP_US);
+                        break;
+                    }
+
+                    succeed();
+                    break;
+                }
+            }
+            break;
+        }
 
-    for (uint32_t b = 0; b < 32; b++)
-    {
-        uint32_t bit = (crcC ^ tmp) & 1;
+        case Stage::PAYLOAD:
+        {
+            // Word 0 is the word count, then the compressed program (see `GBALoader.h`)
+            const uint32_t words = (image.payloadSize + 3) / 4;
+            const uint32_t val = index == 0 ? words : ((const uint32_t*)image.payload)[index - 1];
+
+            if (link->exchange(val) != (GBA_LOADER_MAGIC | (index & 0xFFFF)))
+            {
+                // The stub starts once the BIOS is done with its logo
+                if (index == 0 ? ++tries == GBA_LOADER_TRIES : ++tries > GBA_WORD_RETRIES)
+                {
+                    // fprintf(stderr, "Loader error at word %zu\n", index);
+                    persistentStats.stats.loaderErrors++;
+                    fail();
+                    break;
+                }
+
+                if (index == 0)
+                    wait(GBA_DETECT_GAP_US);
+                else
+                {
+                    gapUs = gapUs * 2 < GBA_GAP_MAX_US ? gapUs * 2 : GBA_GAP_MAX_US;
+                    wait(gapUs);
+                }
+                break;
+            }
+
+            tries = 0;
+            gapUs -= (gapUs - GBA_GAP_MIN_US) / 8;
+            wait(gapUs);
+
+            if (index++ == words)
+            {
+                // printf("Expanding.\n");
+                succeed();
+            }
+            break;
+        }
 
-        crcC = (crcC >> 1) ^ (bit ? 0xc37b : 0);
-        tmp >>= 1;
+        case Stage::RUNNING:
+            break;
     }
-
-    // -----------------------------------------------------
-    // printf("Waiting for checksum...\n");
-
-    spi32Delay(0x0065);
-
-    do
-    {
-        recv = spi32Delay(0x0065) >> 16;
-        sleep_us(10000);
-
-    } while (recv != 0x0075);
-
-    spi32Delay(0x0066);
-    uint32_t crcGBA = spi32Delay(crcC & 0xFFFF) >> 16;
-
-    // printf("Gba: %x, Cal: %x\n", crcGBA, crcC);
-    // printf("Done.\n");
-
-    deinitSpi32();
-
-    return true;
 }
 
 }
@@ -0,0 +1,236 @@
+/*
+ * SPDX-License-Identifier: CC0-1.0
+ */
+
+#include "gba/multiplay.h"
+
+#include "pico/stdlib.h"
+#include "hardware/irq.h"
+#include "hardware/pio.h"
+
+#include "gba/spi32.h"
+#include "gba/GBAKeyFrame.h"
+#include "gba/generated/gba_sio.pio.h"
+
+namespace gba
+{
+
+// SD, SC and our SO (the GBA's SI) must be consecutive (see README)
+static constexpr uint GBA_SIO_PIN_SD = PICO_DEFAULT_SPI_CSN_PIN; // GP17 <-> GBA SD
+static_assert(PICO_DEFAULT_SPI_SCK_PIN == GBA_SIO_PIN_SD + 1 && PICO_DEFAULT_SPI_TX_PIN == GBA_SIO_PIN_SD + 2);
+
+// pio0 belongs to NeoPico
+static const PIO multiPio = pio1;
+static int multiSm = -1;
+static uint multiOffset;
+
+static uint32_t getSlotDeadlineUs(uint32_t slot) {
+	return (slot + 2) * GBA_MULTI_SLOT_US + GBA_MULTI_SLACK_US;
+}
+
+static uint16_t takeSlotWord() {
+	// Shifted in LSB first from the top, so the 16 bits end up in the upper half
+	return pio_sm_get(multiPio, multiSm) >> 16;
+}
+
+// A missing GBA leaves the state machine waiting for its start bit, with SC held low
+static void resetMulti() {
+	pio_sm_set_enabled(multiPio, multiSm, false);
+	pio_sm_clear_fifos(multiPio, multiSm);
+	pio_sm_restart(multiPio, multiSm);
+	pio_sm_exec(multiPio, multiSm, pio_encode_set(pio_pins, 0b111));
+	pio_sm_exec(multiPio, multiSm, pio_encode_set(pio_pindirs, 0b110));
+	pio_sm_exec(multiPio, multiSm, pio_encode_jmp(multiOffset));
+	pio_sm_set_enabled(multiPio, multiSm, true);
+}
+
+void initMulti() {
+	if (multiSm >= 0)
+		return;
+
+	multiOffset = pio_add_program(multiPio, &gba_multi_program);
+	multiSm = pio_claim_unused_sm(multiPio, true);
+	gba_multi_program_init(multiPio, multiSm, multiOffset, GBA_SIO_PIN_SD, GBA_MULTI_BAUD);
+	pio_sm_set_enabled(multiPio, multiSm, true);
+}
+
+void deinitMulti() {
+	if (multiSm < 0)
+		return;
+
+	stopMultiStream();
+	pio_sm_set_enabled(multiPio, multiSm, false);
+	pio_sm_unclaim(multiPio, multiSm);
+	pio_remove_program(multiPio, &gba_multi_program, multiOffset);
+	multiSm = -1;
+}
+
+void multiExchange(uint16_t val, uint16_t recv[GBA_MULTI_CLIENTS]) {
+	const absolute_time_t start = get_absolute_time();
+	pio_sm_put_blocking(multiPio, multiSm, val);
+
+	uint32_t slot = 0;
+	while (slot < GBA_MULTI_CLIENTS)
+	{
+		if (!pio_sm_is_rx_fifo_empty(multiPio, multiSm))
+			recv[slot++] = takeSlotWord();
+		else if (absolute_time_diff_us(start, get_absolute_time()) > getSlotDeadlineUs(slot))
+			break;
+	}
+
+	if (slot == GBA_MULTI_CLIENTS)
+		return;
+
+	// The GBAs after an empty slot don't get their turn either
+	for (; slot < GBA_MULTI_CLIENTS; slot++)
+		recv[slot] = GBA_MULTI_NO_DATA;
+	resetMulti();
+}
+
+// Background acquisition
+// The timer starts a transfer every interval, and the RX interrupt collects a word per slot.
+// A transfer is published once all slots are in, or by an alarm after the longest a full one takes,
+// with the missing slots as `GBA_MULTI_NO_DATA`.
+
+static constexpr uint32_t MULTI_RING_SIZE = 4;
+
+static repeating_timer_t streamTimer;
+static volatile bool streamActive = false;
+static volatile uint16_t streamTxWord = 0;
+
+static uint16_t streamWords[GBA_MULTI_CLIENTS];
+static volatile uint32_t streamSlot = GBA_MULTI_CLIENTS; // next slot of the transfer on the wire
+
+static uint16_t streamRing[MULTI_RING_SIZE][GBA_MULTI_CLIENTS];
+static volatile uint32_t streamHead = 0;     // entry the next transfer is published into
+static volatile uint32_t streamLatest = 0;   // newest published entry
+static volatile uint32_t streamComplete = 0; // number of published transfers
+
+static void publishMultiTransfer() {
+	for (uint32_t i = 0; i < GBA_MULTI_CLIENTS; i++)
+		streamRing[streamHead][i] = i < streamSlot ? streamWords[i] : GBA_MULTI_NO_DATA;
+
+	streamLatest = streamHead;
+	streamHead = (streamHead + 1) % MULTI_RING_SIZE;
+	streamComplete = streamComplete + 1;
+	streamSlot = GBA_MULTI_CLIENTS;
+}
+
+static void onMultiStreamRx() {
+	while (!pio_sm_is_rx_fifo_empty(multiPio, multiSm)) {
+		const uint16_t word = takeSlotWord();
+		if (streamSlot >= GBA_MULTI_CLIENTS)
+			continue; // left over from a transfer that was already published
+
+		streamWords[streamSlot] = word;
+		streamSlot = streamSlot + 1;
+		if (streamSlot == GBA_MULTI_CLIENTS)
+			publishMultiTransfer();
+	}
+}
+
+static int64_t onMultiStreamTimeout(alarm_id_t, void *) {
+	if (streamActive && streamSlot < GBA_MULTI_CLIENTS) {
+		publishMultiTransfer();
+		resetMulti();
+	}
+
+	return 0;
+}
+
+static void kickMultiStream() {
+	streamSlot = 0;
+	pio_sm_put(multiPio, multiSm, streamTxWord);
+	add_alarm_in_us(GBA_MULTI_TRANSFER_US, onMultiStreamTimeout, nullptr, true);
+}
+
+static bool onMultiStreamTimer(repeating_timer_t *) {
+	if (!streamActive)
+		return false;
+
+	// Still on the wire, which only happens with intervals shorter than a transfer
+	if (streamSlot < GBA_MULTI_CLIENTS)
+		return true;
+
+	kickMultiStream();
+	return true;
+}
+
+void startMultiStream(uint32_t intervalUs) {
+	if (streamActive)
+		return;
+
+	streamHead = 0;
+	streamComplete = 0;
+	streamSlot = GBA_MULTI_CLIENTS;
+	streamActive = true;
+
+	irq_add_shared_handler(PIO1_IRQ_0, onMultiStreamRx, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+	pio_set_irq0_source_enabled(multiPio, (pio_interrupt_source)(pis_sm0_rx_fifo_not_empty + multiSm), true);
+	irq_set_enabled(PIO1_IRQ_0, true);
+
+	// Prime the ring, so that the very first read (e.g. boot action) sees a real transfer
+	kickMultiStream();
+	absolute_time_t primeTimeout = make_timeout_time_us(2 * GBA_MULTI_TRANSFER_US);
+	while (streamComplete == 0 && !time_reached(primeTimeout))
+		tight_loop_contents();
+
+	add_repeating_timer_us(-(int64_t)intervalUs, onMultiStreamTimer, nullptr, &streamTimer);
+}
+
+void stopMultiStream() {
+	if (!streamActive)
+		return;
+
+	streamActive = false;
+	cancel_repeating_timer(&streamTimer);
+
+	pio_set_irq0_source_enabled(multiPio, (pio_interrupt_source)(pis_sm0_rx_fifo_not_empty + multiSm), false);
+	irq_remove_handler(PIO1_IRQ_0, onMultiStreamRx);
+	resetMulti();
+}
+
+void setMultiStreamTx(uint16_t val) {
+	streamTxWord = val;
+}
+
+uint16_t latestMultiWord(uint32_t client) {
+	if (!streamActive || streamComplete == 0 || client >= GBA_MULTI_CLIENTS)
+		return GBA_MULTI_NO_DATA;
+
+	uint32_t complete;
+	uint16_t word;
+	do {
+		complete = streamComplete;
+		word = streamRing[streamLatest][client];
+	} while (complete != streamComplete); // a newer transfer landed while we were reading
+
+	return word;
+}
+
+uint32_t latestMultiKeyFrame(uint32_t client) {
+	const uint16_t word = latestMultiWord(client);
+	if (word == GBA_MULTI_NO_DATA)
+		return GBA_SPI_ERROR;
+
+	const uint32_t frame = sealKeyFrame(word & GBA_FRAME_KEYS_MASK, word >> GBA_MULTI_FRAME_SEQ_SHIFT);
+
+	// Keep a bad CRC bad, so the decoder counts it and keeps the last good keys
+	return isMultiKeyFrameValid(word) ? frame : frame ^ (1u << GBA_FRAME_CRC_SHIFT);
+}
+
+uint32_t multiFrameCount() {
+	return streamComplete;
+}
+
+bool isMultiBiosWaiting() {
+	for (uint32_t i = 0; i < GBA_MULTI_CLIENTS; i++)
+	{
+		if (latestMultiWord(i) == (0x7200 | GBA_MULTI_CLIENT_IDS[i]))
+			return true;
+	}
+
+	return false;
+}
+
+}
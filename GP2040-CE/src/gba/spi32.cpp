@@ -5,54 +5,323 @@
 #include "gba/spi32.h"
 
 #include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+
+#include "gba/generated/gba_sio.pio.h"
 
 namespace gba
 {
 
-uint32_t swapByte32(uint32_t val) {
-	union {
-		uint32_t u32;
-		uint8_t u8[4];
-	} x;
+// pio0 belongs to NeoPico
+static const PIO sioPio = pio1;
+
+// The links share pio1, so each program is only loaded once for all of them
+struct SharedProgram
+{
+	const pio_program_t* program;
+	uint offset;
+	uint32_t users;
+};
+
+static SharedProgram masterProgram = { &gba_sio_program, 0, 0 };
+static SharedProgram slaveProgram = { &gba_sio_slave_program, 0, 0 };
+
+static uint addSharedProgram(SharedProgram& shared) {
+	if (shared.users++ == 0)
+		shared.offset = pio_add_program(sioPio, shared.program);
+	return shared.offset;
+}
+
+static void removeSharedProgram(SharedProgram& shared) {
+	if (--shared.users == 0)
+		pio_remove_program(sioPio, shared.program, shared.offset);
+}
+
+// Every link, for the interrupt handlers and the stream timer they share
+static Spi32Link* links[NUM_PIO_STATE_MACHINES];
+static uint32_t linkCount = 0;
+
+Spi32Link::Spi32Link(const Spi32Pins& pins, uint32_t bitrate) : pins(pins), bitrate(bitrate) {
+	hard_assert(linkCount < NUM_PIO_STATE_MACHINES);
+	links[linkCount++] = this;
+}
+
+void Spi32Link::setHandshake(bool enabled) {
+	pio_sm_set_enabled(sioPio, sm, false);
+	pio_sm_exec(sioPio, sm, pio_encode_set(pio_y, enabled ? 1 : 0) | pio_encode_sideset(1, 1));
+	pio_sm_set_enabled(sioPio, sm, true);
+}
+
+void Spi32Link::init() {
+	const uint offset = addSharedProgram(masterProgram);
+	sm = pio_claim_unused_sm(sioPio, true);
+	gba_sio_program_init(sioPio, sm, offset, pins.so, pins.si, pins.sc, bitrate);
+	setHandshake(false);
+}
+
+void Spi32Link::deinit() {
+	pio_sm_set_enabled(sioPio, sm, false);
+	pio_sm_unclaim(sioPio, sm);
+	removeSharedProgram(masterProgram);
+	sm = -1;
+}
+
+void Spi32Link::setBitrate(uint32_t bitrate) {
+	this->bitrate = bitrate;
+	pio_sm_set_clkdiv(sioPio, sm, clock_get_hz(clk_sys) / ((float)bitrate * gba_sio_CYCLES_PER_BIT));
+	pio_sm_clkdiv_restart(sioPio, sm);
+}
+
+uint32_t Spi32Link::exchange(uint32_t val) {
+	put(val);
+	return get();
+}
+
+void Spi32Link::put(uint32_t val) {
+	pio_sm_put_blocking(sioPio, sm, val);
+}
+
+uint32_t Spi32Link::get() {
+	return pio_sm_get_blocking(sioPio, sm);
+}
 
-	x.u32 = val;
+// Background acquisition
+// The TX/RX DMA channel pair of each link feeds one frame per exchange to its state machine, and the RX
+// channel writes each frame into the next slot of a small ring, so `latestFrame()` never
+// reads a slot that is still on the wire.
+// One timer kicks every streaming link at once, so their exchanges overlap on the wire.
 
-	uint8_t tmp, tmp2;
-	tmp = x.u8[0];
-	tmp2 = x.u8[3];
-	x.u8[0] = tmp2;
-	x.u8[3] = tmp;
-	tmp = x.u8[1];
-	tmp2 = x.u8[2];
-	x.u8[1] = tmp2;
-	x.u8[2] = tmp;
+static repeating_timer_t streamTimer;
+static uint32_t streamUsers = 0;
+static bool streamDmaHandlerAdded = false;
 
-	return x.u32;
+uint32_t Spi32Link::prepareKick() {
+	dma_channel_set_read_addr(txChannel, &txFrame, false);
+	dma_channel_set_write_addr(rxChannel, &ring[head], false);
+	return (1u << txChannel) | (1u << rxChannel);
 }
 
-void initSpi32() {
-	spi_init(spi_default, 1000 * 1000);
-	gpio_set_function(PICO_DEFAULT_SPI_RX_PIN, GPIO_FUNC_SPI);
-	gpio_set_function(PICO_DEFAULT_SPI_SCK_PIN, GPIO_FUNC_SPI);
-	gpio_set_function(PICO_DEFAULT_SPI_TX_PIN, GPIO_FUNC_SPI);
-	gpio_set_function(PICO_DEFAULT_SPI_CSN_PIN, GPIO_FUNC_SPI);
-	spi_set_format(spi0, 8, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST);
+bool Spi32Link::onStreamTimer(repeating_timer_t *) {
+	uint32_t kickMask = 0;
+
+	for (uint32_t i = 0; i < linkCount; i++) {
+		Spi32Link& link = *links[i];
+		if (!link.streamActive || link.streamPush)
+			continue;
+
+		// The GBA hasn't signalled ready for a whole interval (busy, or unplugged)
+		if (dma_channel_is_busy(link.rxChannel)) {
+			if (link.streamMisses < link.staleIntervals)
+				link.streamMisses = link.streamMisses + 1;
+		} else
+			kickMask |= link.prepareKick();
+	}
+
+	if (kickMask)
+		dma_start_channel_mask(kickMask);
+
+	return true;
 }
 
-void deinitSpi32() {
-    spi_deinit(spi_default);
+void Spi32Link::completeFrame() {
+	times[head] = time_us_64();
+	latest = head;
+	head = (head + 1) % RING_SIZE;
+	complete = complete + 1;
 }
 
-uint32_t spi32(uint32_t val) {
-	union {
-		uint32_t u32;
-		uint8_t u8[4];
-	} send, recv;
+void Spi32Link::onStreamDma() {
+	for (uint32_t i = 0; i < linkCount; i++) {
+		Spi32Link& link = *links[i];
+		if (link.rxChannel < 0 || !dma_channel_get_irq0_status(link.rxChannel))
+			continue;
+
+		dma_channel_acknowledge_irq0(link.rxChannel);
+
+		link.completeFrame();
+		link.streamMisses = 0;
+	}
+}
+
+void Spi32Link::startStream(uint32_t intervalUs) {
+	if (streamActive)
+		return;
+
+	if (txChannel < 0) {
+		txChannel = dma_claim_unused_channel(true);
+		rxChannel = dma_claim_unused_channel(true);
+	}
+
+	if (!streamDmaHandlerAdded) {
+		irq_add_shared_handler(DMA_IRQ_0, onStreamDma, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+		irq_set_enabled(DMA_IRQ_0, true);
+		streamDmaHandlerAdded = true;
+	}
+
+	dma_channel_config txConfig = dma_channel_get_default_config(txChannel);
+	channel_config_set_transfer_data_size(&txConfig, DMA_SIZE_32);
+	channel_config_set_read_increment(&txConfig, false);
+	channel_config_set_write_increment(&txConfig, false);
+	channel_config_set_dreq(&txConfig, pio_get_dreq(sioPio, sm, true));
+	dma_channel_configure(txChannel, &txConfig, &sioPio->txf[sm], &txFrame, 1, false);
+
+	dma_channel_config rxConfig = dma_channel_get_default_config(rxChannel);
+	channel_config_set_transfer_data_size(&rxConfig, DMA_SIZE_32);
+	channel_config_set_read_increment(&rxConfig, false);
+	channel_config_set_write_increment(&rxConfig, false);
+	channel_config_set_dreq(&rxConfig, pio_get_dreq(sioPio, sm, false));
+	dma_channel_configure(rxChannel, &rxConfig, &ring[0], &sioPio->rxf[sm], 1, false);
+
+	// The GBA program is a `LinkSPI` slave, so only clock it once it's ready
+	setHandshake(true);
+	dma_channel_set_irq0_enabled(rxChannel, true);
 
-	send.u32 = swapByte32(val);
-	spi_write_read_blocking(spi_default, send.u8, recv.u8, 4);
+	head = 0;
+	complete = 0;
+	staleIntervals = (GBA_STREAM_STALE_US + intervalUs - 1) / intervalUs;
+	if (staleIntervals < STALE_INTERVALS)
+		staleIntervals = STALE_INTERVALS;
+	streamMisses = staleIntervals;
+
+	// Prime the ring, so that the very first read (e.g. boot action) sees a real frame
+	dma_start_channel_mask(prepareKick());
+	absolute_time_t primeTimeout = make_timeout_time_us(intervalUs);
+	while (complete == 0 && !time_reached(primeTimeout))
+		tight_loop_contents();
+
+	// Only join the timer once the priming exchange is done, so it never kicks a busy pair
+	streamActive = true;
+	if (streamUsers++ == 0)
+		add_repeating_timer_us(-(int64_t)intervalUs, onStreamTimer, nullptr, &streamTimer);
+}
+
+void Spi32Link::stopStream() {
+	if (!streamActive)
+		return;
+
+	streamActive = false;
+	if (--streamUsers == 0)
+		cancel_repeating_timer(&streamTimer);
+
+	// The state machine may still be waiting on the GBA, so don't wait for it
+	dma_channel_set_irq0_enabled(rxChannel, false);
+	dma_channel_abort(txChannel);
+	dma_channel_abort(rxChannel);
+	dma_channel_acknowledge_irq0(rxChannel);
+
+	pio_sm_set_enabled(sioPio, sm, false);
+	pio_sm_clear_fifos(sioPio, sm);
+	pio_sm_restart(sioPio, sm);
+	pio_sm_exec(sioPio, sm, pio_encode_jmp(masterProgram.offset) | pio_encode_sideset(1, 1));
+	// SI back high, in case it was asking the GBA for a frame
+	pio_sm_exec(sioPio, sm, pio_encode_mov_not(pio_pins, pio_null) | pio_encode_sideset(1, 1));
+	setHandshake(false);
+}
+
+void Spi32Link::setStreamTx(uint32_t val) {
+	txFrame = val;
+}
+
+// Push mode
+// The GBA clocks the frames itself, so the slave state machine raises an interrupt
+// for each one, and the handler timestamps it into the same ring.
+
+static uint32_t pushUsers = 0;
+
+void Spi32Link::onPush() {
+	for (uint32_t i = 0; i < linkCount; i++) {
+		Spi32Link& link = *links[i];
+		if (link.pushSm < 0)
+			continue;
+
+		while (!pio_sm_is_rx_fifo_empty(sioPio, link.pushSm)) {
+			link.ring[link.head] = pio_sm_get(sioPio, link.pushSm);
+			link.completeFrame();
+		}
+	}
+}
+
+void Spi32Link::startPush(uint32_t timeoutUs) {
+	if (streamActive)
+		return;
+
+	const uint offset = addSharedProgram(slaveProgram);
+	pushSm = pio_claim_unused_sm(sioPio, true);
+	gba_sio_slave_program_init(sioPio, pushSm, offset, pins.so, pins.si);
+
+	head = 0;
+	complete = 0;
+	streamPush = true;
+	streamActive = true;
+
+	if (pushUsers++ == 0) {
+		irq_add_shared_handler(PIO1_IRQ_0, onPush, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+		irq_set_enabled(PIO1_IRQ_0, true);
+	}
+	pio_set_irq0_source_enabled(sioPio, (pio_interrupt_source)(pis_sm0_rx_fifo_not_empty + pushSm), true);
+	pio_sm_set_enabled(sioPio, pushSm, true);
+
+	// The GBA keeps re-sending its keys, so wait for one to have a real frame on the first read
+	absolute_time_t primeTimeout = make_timeout_time_us(timeoutUs);
+	while (complete == 0 && !time_reached(primeTimeout))
+		tight_loop_contents();
+}
+
+void Spi32Link::stopPush() {
+	if (!streamActive || !streamPush)
+		return;
+
+	pio_sm_set_enabled(sioPio, pushSm, false);
+	pio_set_irq0_source_enabled(sioPio, (pio_interrupt_source)(pis_sm0_rx_fifo_not_empty + pushSm), false);
+	if (--pushUsers == 0)
+		irq_remove_handler(PIO1_IRQ_0, onPush);
+
+	// Let go of SI, so the GBA doesn't see us ready anymore
+	gpio_pull_up(pins.si);
+	pio_sm_set_pindirs_with_mask(sioPio, pushSm, 0, 1u << pins.si);
+
+	pio_sm_unclaim(sioPio, pushSm);
+	removeSharedProgram(slaveProgram);
+	pushSm = -1;
+
+	streamPush = false;
+	streamActive = false;
+}
+
+bool Spi32Link::isStale() const {
+	if (streamPush)
+		return complete == 0 || time_us_64() - times[latest] > GBA_PUSH_TIMEOUT_US;
+
+	return streamMisses >= staleIntervals;
+}
+
+uint32_t Spi32Link::latestFrame() const {
+	if (!streamActive || isStale())
+		return GBA_SPI_ERROR;
+
+	uint32_t count, frame;
+	do {
+		count = complete;
+		frame = ring[latest];
+	} while (count != complete); // a newer frame landed while we were reading
+
+	return frame;
+}
+
+uint64_t Spi32Link::latestFrameTime() const {
+	uint32_t count;
+	uint64_t time;
+	do {
+		count = complete;
+		time = times[latest];
+	} while (count != complete);
+
+	return time;
+}
 
-	return swapByte32(recv.u32);
+uint32_t Spi32Link::frameCount() const {
+	return complete;
 }
 
 }
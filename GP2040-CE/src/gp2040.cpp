@@ -7,6 +7,8 @@
 #include "storagemanager.h"
 #include "addonmanager.h"
 
+#include "gba/GBALibrary.h"
+
 #include "addons/analog.h" // Inputs for Core0
 #include "addons/bootsel_button.h"
 #include "addons/dualdirectional.h"
@@ -28,6 +30,8 @@
 #include "usb_driver.h"
 #include "tusb.h"
 
+#include <algorithm>
+
 #define GAMEPAD_DEBOUNCE_MILLIS 5 // make this a class object
 
 static const uint32_t WEBCONFIG_HOTKEY_ACTIVATION_TIME_MS = 50;
@@ -36,6 +40,12 @@ static const uint32_t WEBCONFIG_HOTKEY_HOLD_TIME_MS = 4000;
 GP2040::GP2040() : nextRuntime(0) {
 	Storage::getInstance().SetGamepad(new Gamepad(GAMEPAD_DEBOUNCE_MILLIS));
 	Storage::getInstance().SetProcessedGamepad(new Gamepad(GAMEPAD_DEBOUNCE_MILLIS));
+#if GBA_LINK_PLAYERS > 1
+	for (uint8_t i = 0; i < GBA_LINK_PLAYERS - 1; i++) {
+		gbaPlayers[i] = new Gamepad(GAMEPAD_DEBOUNCE_MILLIS);
+		gbaPlayers[i]->setGBAPlayer(i + 1);
+	}
+#endif
 }
 
 GP2040::~GP2040() {
@@ -45,6 +55,10 @@ void GP2040::setup() {
     // Setup Gamepad and Gamepad Storage
 	Gamepad * gamepad = Storage::getInstance().GetGamepad();
 	gamepad->setup();
+#if GBA_LINK_PLAYERS > 1
+	for (Gamepad * player : gbaPlayers)
+		player->setup();
+#endif
 
 	const BootAction bootAction = getBootAction();
 	switch (bootAction) {
@@ -69,18 +83,7 @@ void GP2040::setup() {
 		case BootAction::SET_INPUT_MODE_KEYBOARD:
 		case BootAction::NONE:
 			{
-				InputMode inputMode = gamepad->options.inputMode;
-				if (bootAction == BootAction::SET_INPUT_MODE_HID) {
-					inputMode = INPUT_MODE_HID;
-				} else if (bootAction == BootAction::SET_INPUT_MODE_SWITCH) {
-					inputMode = INPUT_MODE_SWITCH;
-				} else if (bootAction == BootAction::SET_INPUT_MODE_XINPUT) {
-					inputMode = INPUT_MODE_XINPUT;
-				} else if (bootAction == BootAction::SET_INPUT_MODE_PS4) {
-					inputMode = INPUT_MODE_PS4;
-				} else if (bootAction == BootAction::SET_INPUT_MODE_KEYBOARD) {
-					inputMode = INPUT_MODE_KEYBOARD;
-				}
+				InputMode inputMode = getBootInputMode(bootAction, gamepad->options.inputMode);
 
 				if (inputMode != gamepad->options.inputMode) {
 					// Save the changed input mode
@@ -88,7 +91,21 @@ void GP2040::setup() {
 					gamepad->save();
 				}
 
+#if GBA_LINK_PLAYERS > 1
+				// One HID interface per GBA (DirectInput only, the other modes only report the first GBA)
+				initialize_driver(inputMode, GBA_LINK_PLAYERS);
+#else
 				initialize_driver(inputMode);
+#endif
+				sofScheduler.setup(GAMEPAD_POLL_MICRO);
+				startWakeStats();
+				startAddonTimings();
+			#if GAMEPAD_STAGE_PROFILE
+				startStageProfile();
+			#endif
+			#if GAMEPAD_LATENCY_TRACE
+				latencyTracer.setup();
+			#endif
 				break;
 			}
 	}
@@ -112,9 +129,16 @@ void GP2040::setup() {
 
 void GP2040::run() {
 	Gamepad * gamepad = Storage::getInstance().GetGamepad();
-	Gamepad * processedGamepad = Storage::getInstance().GetProcessedGamepad();
 	bool configMode = Storage::getInstance().GetConfigMode();
 	while (1) { // LOOP
+		// GBA link comes up in the background, so USB enumerates during the multiboot upload
+		if (gamepad->stepGBALink())
+			processGBABootAction(gamepad);
+	#if GBA_LINK_PLAYERS > 1
+		for (Gamepad * player : gbaPlayers)
+			player->stepGBALink();
+	#endif
+
 		// Config Loop (Web-Config does not require gamepad)
 		if (configMode == true) {
 			ConfigManager& configManager = ConfigManager::getInstance();
@@ -122,45 +146,93 @@ void GP2040::run() {
 
 			gamepad->read();
 			webConfigHotkey.process(gamepad, configMode);
+			Storage::getInstance().PublishProcessedGamepad(gamepad->state); // for the display's config screens
+			getLoopWake(1).ring();
 
 			continue;
 		}
 
 		if (nextRuntime > getMicro()) { // fix for unsigned
-			sleep_us(50); // Give some time back to our CPU (lower power consumption)
+			// Sleep until the next cycle, or until the GBA link has something to do
+			uint64_t wakeTime = std::min(nextRuntime, gamepad->getGBALinkWakeTime());
+		#if GBA_LINK_PLAYERS > 1
+			for (Gamepad * player : gbaPlayers)
+				wakeTime = std::min(wakeTime, player->getGBALinkWakeTime());
+		#endif
+			getLoopWake(0).sleepUntil(wakeTime);
 			continue;
 		}
 
+		sofScheduler.beginCycle(getMicro());
+
 		// Gamepad Features
+		PROFILE_START();
 		gamepad->read(); 	// gpio pin reads
-	#if GAMEPAD_DEBOUNCE_MILLIS > 0
+		PROFILE_LAP(READ);
+	#if GAMEPAD_LATENCY_TRACE
+		latencyTracer.onRead(gamepad->getGBAReading(), getMicro());
+	#endif
+	#if GAMEPAD_DEBOUNCE_MILLIS > 0 && !GAMEPAD_CORE1_INPUT // core1 debounces as it samples
 		gamepad->debounce();
+		PROFILE_LAP(DEBOUNCE);
 	#endif
 		gamepad->hotkey(); 	// check for MPGS hotkeys
+		PROFILE_LAP(HOTKEY);
 		webConfigHotkey.process(gamepad, configMode);
 
 		// Pre-Process add-ons for MPGS
+		PROFILE_START();
 		addons.PreprocessAddons(ADDON_PROCESS::CORE0_INPUT);
+		PROFILE_LAP(PREPROCESS_ADDONS);
 		
 		gamepad->process(); // process through MPGS
+		PROFILE_LAP(PROCESS);
 
 		// (Post) Process for add-ons
 		addons.ProcessAddons(ADDON_PROCESS::CORE0_INPUT);
-
-		// Copy Processed Gamepad for Core1 (race condition otherwise)
-		memcpy(&processedGamepad->state, &gamepad->state, sizeof(GamepadState));
+		PROFILE_LAP(PROCESS_ADDONS);
 
 		// USB FEATURES : Send/Get USB Features (including Player LEDs on X-Input)
-		send_report(gamepad->getReport(), gamepad->getReportSize());
+		void * report = gamepad->getReport();
+	#if GAMEPAD_LATENCY_TRACE
+		latencyTracer.onBuilt(getMicro());
+	#endif
+		const bool armed = send_report(report, gamepad->getReportSize());
+		PROFILE_LAP(SEND_REPORT);
+	#if GAMEPAD_LATENCY_TRACE
+		latencyTracer.onQueued(armed, getMicro());
+	#endif
+	#if GBA_LINK_PLAYERS > 1
+		for (uint8_t i = 0; i < GBA_LINK_PLAYERS - 1; i++) {
+			Gamepad * player = gbaPlayers[i];
+			player->read();
+		#if GAMEPAD_DEBOUNCE_MILLIS > 0 && !GAMEPAD_CORE1_INPUT
+			player->debounce();
+		#endif
+			player->process();
+			send_player_report(i + 1, player->getReport(), player->getReportSize());
+		}
+	#endif
+		sofScheduler.endCycle(getMicro(), armed);
+
 		Storage::getInstance().ClearFeatureData();
+		PROFILE_START();
 		receive_report(Storage::getInstance().GetFeatureData());
+		PROFILE_LAP(RECEIVE_REPORT);
+
+		// Hand the processed gamepad and the feature data over to core1, which runs on them right away
+		Storage::getInstance().PublishProcessedGamepad(gamepad->state);
+		getLoopWake(1).ring();
 
 		// Process USB Reports
 		addons.ProcessAddons(ADDON_PROCESS::CORE0_USBREPORT);
 
+		PROFILE_START();
 		tud_task(); // TinyUSB Task update
+		PROFILE_LAP(TUD_TASK);
 
-		nextRuntime = getMicro() + GAMEPAD_POLL_MICRO;
+		// Just ahead of the host's next IN token, or free-running without USB frames
+		nextRuntime = sofScheduler.getNextRuntime(getMicro());
 	}
 }
 
@@ -169,43 +241,89 @@ GP2040::BootAction GP2040::getBootAction() {
 		case System::BootMode::GAMEPAD: return BootAction::NONE;
 		case System::BootMode::WEBCONFIG: return BootAction::ENTER_WEBCONFIG_MODE;
 		case System::BootMode::USB: return BootAction::ENTER_USB_MODE;
-		case System::BootMode::DEFAULT:
-			{
-				// Determine boot action based on gamepad state during boot
-				Gamepad * gamepad = Storage::getInstance().GetGamepad();
-				gamepad->read();
+		case System::BootMode::DEFAULT: return getGamepadBootAction();
+	}
 
-				if (gamepad->pressedF1() && gamepad->pressedUp()) {
-					return BootAction::ENTER_USB_MODE;
-				}
-				// else if (gamepad->pressedS2()) {
-				// 	return BootAction::ENTER_WEBCONFIG_MODE;
-				// }
-				  else if (gamepad->pressedL1()) { // P1
-					return BootAction::SET_INPUT_MODE_HID;
-				} else if (gamepad->pressedR1()) { // P2
-					return BootAction::SET_INPUT_MODE_PS4;
-				} else if (gamepad->pressedB1()) { // K1
-					return BootAction::SET_INPUT_MODE_SWITCH;
-				} else if (gamepad->pressedB2()) { // K2
-					return BootAction::SET_INPUT_MODE_XINPUT;
-				} else if (gamepad->pressedR2()) { // K3
-					return BootAction::SET_INPUT_MODE_KEYBOARD;
-				} else {
-					return BootAction::NONE;
-				}
+	return BootAction::NONE;
+}
 
-				break;
-			}
+GP2040::BootAction GP2040::getGamepadBootAction() {
+	// Determine boot action based on gamepad state during boot
+	Gamepad * gamepad = Storage::getInstance().GetGamepad();
+	gamepad->read();
+
+	if (gamepad->pressedF1() && gamepad->pressedUp()) {
+		return BootAction::ENTER_USB_MODE;
+	}
+	// else if (gamepad->pressedS2()) {
+	// 	return BootAction::ENTER_WEBCONFIG_MODE;
+	// }
+	  else if (gamepad->pressedL1()) { // P1
+		return BootAction::SET_INPUT_MODE_HID;
+	} else if (gamepad->pressedR1()) { // P2
+		return BootAction::SET_INPUT_MODE_PS4;
+	} else if (gamepad->pressedB1()) { // K1
+		return BootAction::SET_INPUT_MODE_SWITCH;
+	} else if (gamepad->pressedB2()) { // K2
+		return BootAction::SET_INPUT_MODE_XINPUT;
+	} else if (gamepad->pressedR2()) { // K3
+		return BootAction::SET_INPUT_MODE_KEYBOARD;
 	}
 
 	return BootAction::NONE;
 }
 
+InputMode GP2040::getBootInputMode(BootAction bootAction, InputMode inputMode) {
+	switch (bootAction) {
+		case BootAction::SET_INPUT_MODE_HID: return INPUT_MODE_HID;
+		case BootAction::SET_INPUT_MODE_SWITCH: return INPUT_MODE_SWITCH;
+		case BootAction::SET_INPUT_MODE_XINPUT: return INPUT_MODE_XINPUT;
+		case BootAction::SET_INPUT_MODE_PS4: return INPUT_MODE_PS4;
+		case BootAction::SET_INPUT_MODE_KEYBOARD: return INPUT_MODE_KEYBOARD;
+		default: return inputMode;
+	}
+}
+
+void GP2040::processGBABootAction(Gamepad* gamepad) {
+	// The GBA only answers once our program runs on it, which is after USB came up with the saved Input Mode.
+	// So a boot key held by then saves the new Input Mode, and reboots into it.
+#if GAMEPAD_CORE1_INPUT
+	// Core1 only samples the link once it's up
+	gamepad->waitForInput();
+#endif
+	const BootAction bootAction = getGamepadBootAction();
+	if (bootAction == BootAction::ENTER_USB_MODE) {
+		reset_usb_boot(0, 0);
+		return;
+	}
+
+	bool changed = false;
+	InputMode inputMode = getBootInputMode(bootAction, gamepad->options.inputMode);
+	if (inputMode != gamepad->options.inputMode) {
+		gamepad->options.inputMode = inputMode;
+		changed = true;
+	}
+
+#if !GBA_LINK_MULTI
+	// Likewise for the keys of a GBA library entry, whose program then replaces the running one
+	const int32_t gbaRom = gba::findGBALibraryEntry(gamepad->getGBAKeys());
+	if (gbaRom >= 0 && gbaRom != gamepad->options.gbaRom) {
+		gamepad->options.gbaRom = gbaRom;
+		changed = true;
+	}
+#endif
+
+	if (changed) {
+		gamepad->save();
+		System::reboot(System::BootMode::GAMEPAD);
+	}
+}
+
 GP2040::WebConfigHotkey::WebConfigHotkey() :
 	active(false),
 	noButtonsPressedTimeout(nil_time),
-	webConfigHotkeyMask(GAMEPAD_MASK_S2 | GAMEPAD_MASK_B3 | GAMEPAD_MASK_B4),
+	// The GBA has no B3/B4, so it's Select + Start + L + R
+	webConfigHotkeyMask(GAMEPAD_MASK_S1 | GAMEPAD_MASK_S2 | GAMEPAD_MASK_L1 | GAMEPAD_MASK_R1),
 	webConfigHotkeyHoldTimeout(nil_time) {
 }
 
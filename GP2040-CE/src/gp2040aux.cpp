@@ -27,14 +27,20 @@ void GP2040Aux::setup() {
 	addons.LoadAddon(new BoardLedAddon(), CORE1_LOOP);
 	addons.LoadAddon(new BuzzerSpeakerAddon(), CORE1_LOOP);
 	addons.LoadAddon(new PS4ModeAddon(), CORE1_LOOP);
+
+#if GAMEPAD_CORE1_INPUT
+	// Sample the GBAs from here on, on a timer of core1's
+	Gamepad::startAcquisition();
+#endif
 }
 
 void GP2040Aux::run() {
+	LoopWake& loopWake = getLoopWake(1);
 	while (1) {
-		if (nextRuntime > getMicro()) { // fix for unsigned
-			sleep_us(50); // Give some time back to our CPU (lower power consumption)
-			continue;
-		}
+		// As soon as core0 has a new gamepad state, or once per poll without one (e.g. Web Config mode)
+		loopWake.sleepUntil(nextRuntime);
+		Storage::getInstance().TakeProcessedGamepad();
+		AddonManager::AcquireAddons(); // the slow half of the core0 addons
 		addons.ProcessAddons(CORE1_LOOP);
 		nextRuntime = getMicro() + GAMEPAD_POLL_MICRO;
 	}
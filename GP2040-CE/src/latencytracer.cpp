@@ -0,0 +1,135 @@
+#include "latencytracer.h"
+
+#if GAMEPAD_LATENCY_TRACE
+
+#include "pico/stdlib.h"
+#include "hardware/irq.h"
+#include "hardware/structs/usb.h"
+#include "hardware/sync.h"
+
+#include "persistentstats.h"
+
+// TinyUSB
+#include "usb_driver.h"
+
+static const uint32_t LEG_COUNT = (uint32_t)LatencyLeg::COUNT;
+
+static const char * const LEG_NAMES[LEG_COUNT] = {
+	"link",
+	"pickup",
+	"build",
+	"queue",
+	"host",
+	"total",
+};
+
+// The gamepad report goes out on EP1 IN in every input mode
+static const uint32_t GAMEPAD_IN_EP = 1;
+static const uint32_t IN_BUFFERS_AVAIL = USB_BUF_CTRL_AVAIL | (USB_BUF_CTRL_AVAIL << 16);
+
+// A report the host still hasn't taken by then isn't waited for anymore (e.g. unplugged, suspended)
+static const uint64_t QUEUED_TIMEOUT_US = 100 * 1000;
+
+static LatencyTracer * tracer = nullptr;
+
+static const uint32_t LATENCY_STATS_MAGIC = 0x4c415453; // "LATS"
+
+static PersistentStats<LatencyStats[LATENCY_INPUT_MODES], LATENCY_STATS_MAGIC> __uninitialized_ram(persistentLatencyStats);
+
+const LatencyStats& getLatencyStats(InputMode mode) {
+	return persistentLatencyStats.get()[mode];
+}
+
+const char * getLatencyLegName(LatencyLeg leg) {
+	return LEG_NAMES[(uint32_t)leg];
+}
+
+static bool isReportTaken() {
+	return !(usb_dpram->ep_buf_ctrl[GAMEPAD_IN_EP].in & IN_BUFFERS_AVAIL);
+}
+
+// Microseconds from `from` to `to`, none if the clocks crossed (e.g. a frame time read just after its frame)
+static uint32_t getLegUs(uint64_t from, uint64_t to) {
+	return to > from ? to - from : 0;
+}
+
+void LatencyTracer::setup() {
+	// Start this input mode's stats over, and keep the ones the other modes left for Web Config
+	LatencyStats * stats = persistentLatencyStats.get();
+	const InputMode mode = get_input_mode();
+	if (mode < LATENCY_INPUT_MODES)
+		stats[mode].reset();
+	tracer = this;
+
+	// Alongside the TinyUSB handler, which leaves the buffer control alone
+	irq_add_shared_handler(USBCTRL_IRQ, onUsbIrq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+}
+
+void LatencyTracer::onRead(const GBAReading& reading, uint64_t nowUs) {
+	if (reading.keys == lastKeys)
+		return;
+	lastKeys = reading.keys;
+
+	// The edge before has a report on its way, which will carry this one too
+	if (state == State::QUEUED && nowUs - queuedUs < QUEUED_TIMEOUT_US) {
+		const InputMode mode = get_input_mode();
+		if (mode < LATENCY_INPUT_MODES)
+			persistentLatencyStats.stats[mode].overlapped++;
+		return;
+	}
+
+	// Otherwise the edge before never made it into a report of its own (e.g. an unmapped key): this one replaces it
+	dated = reading.edgeTime != 0;
+	frameUs = reading.frameTime;
+	edgeUs = dated ? reading.edgeTime : frameUs;
+	readUs = nowUs;
+	state = State::READ;
+}
+
+void LatencyTracer::onBuilt(uint64_t nowUs) {
+	// A report that couldn't be handed over is built again, so keep the first one
+	if (state != State::READ)
+		return;
+
+	builtUs = nowUs;
+	state = State::BUILT;
+}
+
+void LatencyTracer::onQueued(bool queued, uint64_t nowUs) {
+	if (state != State::BUILT || !queued)
+		return;
+
+	queuedUs = nowUs;
+
+	// The host may have taken it already, before the interrupt could tell
+	const uint32_t status = save_and_disable_interrupts();
+	state = State::QUEUED;
+	if (isReportTaken())
+		complete(time_us_64());
+	restore_interrupts(status);
+}
+
+void LatencyTracer::onUsbIrq() {
+	LatencyTracer * t = tracer;
+	if (t->state == State::QUEUED && isReportTaken())
+		t->complete(time_us_64());
+}
+
+void LatencyTracer::complete(uint64_t nowUs) {
+	state = State::IDLE;
+
+	const InputMode mode = get_input_mode();
+	if (mode >= LATENCY_INPUT_MODES)
+		return;
+
+	LatencyHistogram * legs = persistentLatencyStats.stats[mode].legs;
+	if (dated)
+		legs[(uint32_t)LatencyLeg::LINK].add(getLegUs(edgeUs, frameUs));
+	legs[(uint32_t)LatencyLeg::PICKUP].add(getLegUs(frameUs, readUs));
+	legs[(uint32_t)LatencyLeg::BUILD].add(getLegUs(readUs, builtUs));
+	legs[(uint32_t)LatencyLeg::QUEUE].add(getLegUs(builtUs, queuedUs));
+	legs[(uint32_t)LatencyLeg::HOST].add(getLegUs(queuedUs, nowUs));
+	legs[(uint32_t)LatencyLeg::TOTAL].add(getLegUs(edgeUs, nowUs));
+}
+
+#endif
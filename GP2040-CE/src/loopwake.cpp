@@ -0,0 +1,84 @@
+#include "loopwake.h"
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#include "persistentstats.h"
+
+// Alarm interrupt and WFE exit, ahead of the deadline
+static const uint64_t WAKE_AHEAD_US = 10;
+
+static const uint32_t NUM_LOOPS = 2;
+
+static LoopWake loopWakes[NUM_LOOPS];
+
+static const uint32_t WAKE_STATS_MAGIC = 0x574b5354; // "WKST"
+
+static PersistentStats<WakeStats[NUM_LOOPS], WAKE_STATS_MAGIC> __uninitialized_ram(persistentWakeStats);
+static volatile bool recordingWakeStats = false;
+
+void startWakeStats() {
+	persistentWakeStats.reset();
+	recordingWakeStats = true;
+}
+
+const WakeStats& getWakeStats(uint32_t core) {
+	return persistentWakeStats.get()[core];
+}
+
+LoopWake& getLoopWake(uint32_t core) {
+	return loopWakes[core];
+}
+
+int64_t LoopWake::onAlarm(alarm_id_t, void * userData) {
+	static_cast<LoopWake *>(userData)->alarmFired = true;
+
+	// Alarms interrupt core0, so wake core1 as well
+	__sev();
+	return 0;
+}
+
+bool LoopWake::sleepUntil(uint64_t deadlineUs) {
+	if (deadlineUs > time_us_64() + WAKE_AHEAD_US) {
+		alarmFired = false;
+		const alarm_id_t alarm = add_alarm_at(from_us_since_boot(deadlineUs - WAKE_AHEAD_US), onAlarm, this, true);
+
+		if (alarm < 0) {
+			// No alarm slot left, so nothing would end the WFE: busy wait instead, still for the doorbell too
+			while (!rung && time_us_64() < deadlineUs)
+				tight_loop_contents();
+		} else {
+			while (!alarmFired && !rung)
+				__wfe();
+
+			if (!alarmFired && alarm > 0)
+				cancel_alarm(alarm);
+		}
+	}
+
+	WakeStats & stats = persistentWakeStats.stats[get_core_num()];
+
+	if (rung) {
+		rung = false;
+		if (recordingWakeStats)
+			stats.doorbells++;
+		return false;
+	}
+
+	busy_wait_until(from_us_since_boot(deadlineUs));
+
+	if (recordingWakeStats) {
+		const uint32_t lateUs = time_us_64() - deadlineUs;
+		stats.deadlines++;
+		stats.totalLateUs += lateUs;
+		if (lateUs > stats.worstLateUs)
+			stats.worstLateUs = lateUs;
+	}
+
+	return true;
+}
+
+void LoopWake::ring() {
+	rung = true;
+	__sev();
+}
@@ -9,9 +9,9 @@
 // GP2040 includes
 #include "gp2040.h"
 #include "gp2040aux.h"
+#include "storagemanager.h"
 
 // GBA multiboot includes
-#include "gba/multiboot.h"
 #include "../../build/gba_rom.hpp"
 
 // Launch our second core with additional modules loaded in
@@ -25,14 +25,24 @@ void core1() {
 }
 
 int main() {
-	// Send GBA program via SPI, which sends its key presses to the RPi Pico
-	bool isAlreadyRunning = !gba::sendGBARom(LinkSPI_demo_mb_gba, LinkSPI_demo_mb_gba_len);
-	// Give user some time to change Input Mode (https://gp2040-ce.info/#/usage?id=input-modes)
-	if (!isAlreadyRunning)
-		sleep_ms(3000);
-
 	// Create GP2040 Main Core (core0), Core1 is dependent on Core0
 	GP2040 * gp2040 = new GP2040();
+	// GBA program is sent via multiboot from the core0 loop, and then sends its key presses to the RPi Pico
+#if GBA_LINK_MULTI
+	// Multi-Play: sent as is to every GBA on the link, which has no fingerprint query
+	Storage::getInstance().GetGamepad()->setGBARom({
+		LinkCable_client_mb_gba, LinkCable_client_mb_gba_len,
+		nullptr, 0,
+		0
+	});
+#else
+	// It goes compressed, through a loader stub that expands it on the GBA, unless the GBA already runs it
+	Storage::getInstance().GetGamepad()->setGBARom({
+		LinkSPI_loader_mb_gba, LinkSPI_loader_mb_gba_len,
+		LinkSPI_demo_mb_gba_lz, LinkSPI_demo_mb_gba_lz_len,
+		LinkSPI_demo_fingerprint
+	});
+#endif
 	gp2040->setup();
 
 	// Create GP2040 Thread for Core1
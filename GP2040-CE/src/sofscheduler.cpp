@@ -0,0 +1,144 @@
+#include "sofscheduler.h"
+
+#include "pico/stdlib.h"
+#include "hardware/structs/usb.h"
+#include "hardware/sync.h"
+
+#include "persistentstats.h"
+
+// TinyUSB
+#include "usb_driver.h"
+
+// USB full-speed frames, numbered on 11 bits
+static const int32_t FRAME_US = 1000;
+static const uint32_t FRAME_MASK = 0x7ff;
+
+// Without a SOF for this long, the cycle runs free
+static const uint64_t SOF_TIMEOUT_US = 3 * FRAME_US;
+
+// The aim point is first searched with steps halving on each change of direction, from COARSE_STEP_US.
+// Once they're down to MISS_STEP_US, a hit moves it HIT_STEP_US later and a miss MISS_STEP_US earlier,
+// which settles where about HIT_STEP_US / (HIT_STEP_US + MISS_STEP_US) of the reports miss their frame.
+static const int32_t COARSE_STEP_US = 256;
+static const int32_t MISS_STEP_US = 32;
+static const int32_t HIT_STEP_US = 1;
+
+// The gamepad report goes out on EP1 IN in every input mode
+static const uint32_t GAMEPAD_IN_EP = 1;
+static const uint32_t IN_BUFFERS_AVAIL = USB_BUF_CTRL_AVAIL | (USB_BUF_CTRL_AVAIL << 16);
+
+static SofScheduler * scheduler = nullptr;
+
+static const uint32_t CYCLE_STATS_MAGIC = 0x43594353; // "CYCS"
+
+static PersistentStats<CycleStats, CYCLE_STATS_MAGIC> __uninitialized_ram(persistentCycleStats);
+
+const CycleStats& getCycleStats() {
+	return persistentCycleStats.get();
+}
+
+void SofScheduler::setup(uint32_t periodUs) {
+	this->periodUs = periodUs;
+	stepUs = COARSE_STEP_US;
+	persistentCycleStats.reset().periodUs = periodUs;
+	scheduler = this;
+	set_sof_callback(onSof);
+}
+
+void SofScheduler::onSof(uint32_t frameCount) {
+	SofScheduler & s = *scheduler;
+	const uint32_t frame = frameCount & FRAME_MASK;
+	s.sofUs = time_us_64();
+	s.sofFrame = frame;
+
+	if (!s.pending)
+		return;
+
+	// Still before the aimed frame (armed at the end of the one before)
+	const uint32_t framesPast = (frame - s.pendingFrame) & FRAME_MASK;
+	if (framesPast == 0)
+		return;
+
+	s.pending = false;
+	if (framesPast > 1) // a SOF went missing, so we can't tell
+		return;
+
+	// The host has taken the report if the buffer isn't available anymore
+	const bool hit = !(usb_dpram->ep_buf_ctrl[GAMEPAD_IN_EP].in & IN_BUFFERS_AVAIL);
+	const int32_t direction = hit ? 1 : -1;
+	int32_t step;
+
+	if (s.stepUs > MISS_STEP_US) {
+		if (s.lastStep != 0 && direction != s.lastStep)
+			s.stepUs = s.stepUs / 2;
+		s.lastStep = direction;
+		step = s.stepUs;
+	} else
+		step = hit ? HIT_STEP_US : MISS_STEP_US;
+
+	if (hit)
+		s.hits = s.hits + 1;
+	else
+		s.misses = s.misses + 1;
+
+	int32_t armOffset = s.armOffsetUs + direction * step;
+	if (armOffset < -FRAME_US + 1)
+		armOffset = -FRAME_US + 1;
+	else if (armOffset > FRAME_US - 1)
+		armOffset = FRAME_US - 1;
+	s.armOffsetUs = armOffset;
+}
+
+bool SofScheduler::isLocked(uint64_t nowUs) const {
+	// Both halves from the same SOF
+	const uint32_t status = save_and_disable_interrupts();
+	const uint64_t lastSofUs = sofUs;
+	restore_interrupts(status);
+
+	return lastSofUs != 0 && nowUs - lastSofUs < SOF_TIMEOUT_US;
+}
+
+void SofScheduler::beginCycle(uint64_t nowUs) {
+	cycleStartUs = nowUs;
+}
+
+void SofScheduler::endCycle(uint64_t nowUs, bool armed) {
+	// Follows a slower cycle at once, and a faster one slowly
+	const uint32_t elapsed = nowUs - cycleStartUs;
+	cycleUs = elapsed > cycleUs ? elapsed : cycleUs - (cycleUs - elapsed) / 16;
+
+	CycleStats & stats = persistentCycleStats.stats;
+	stats.cycles++;
+	if (elapsed > stats.worstUs)
+		stats.worstUs = elapsed;
+	if (elapsed > periodUs)
+		stats.overruns++;
+
+	if (!armed || !isLocked(nowUs))
+		return;
+
+	// Aimed at the frame whose arm point is nearest
+	const uint32_t status = save_and_disable_interrupts();
+	const int64_t sinceArmPoint = (int64_t)(nowUs - sofUs) - armOffsetUs;
+	const int64_t frames = (sinceArmPoint + FRAME_US / 2) / FRAME_US;
+	pendingFrame = (sofFrame + (uint32_t)frames) & FRAME_MASK;
+	pending = true;
+	restore_interrupts(status);
+}
+
+uint64_t SofScheduler::getNextRuntime(uint64_t nowUs) const {
+	if (!isLocked(nowUs))
+		return nowUs + periodUs;
+
+	const uint32_t status = save_and_disable_interrupts();
+	const uint64_t lastSofUs = sofUs;
+	restore_interrupts(status);
+
+	// Keep the poll period, give or take half a frame, then line up on the next arm point
+	const int64_t earliest = (int64_t)(cycleStartUs + periodUs) - FRAME_US / 2;
+	int64_t start = (int64_t)lastSofUs + armOffsetUs - (int64_t)cycleUs;
+	if (start < earliest)
+		start += (earliest - start + FRAME_US - 1) / FRAME_US * FRAME_US;
+
+	return start;
+}
@@ -0,0 +1,73 @@
+#include "stageprofiler.h"
+
+#if GAMEPAD_STAGE_PROFILE
+
+#include "pico/stdlib.h"
+#include "hardware/structs/systick.h"
+#include "hardware/regs/m0plus.h"
+
+#include "persistentstats.h"
+
+static const uint32_t STAGE_COUNT = (uint32_t)ProfileStage::COUNT;
+
+static const char * const STAGE_NAMES[STAGE_COUNT] = {
+	"read",
+	"debounce",
+	"hotkey",
+	"PreprocessAddons",
+	"process",
+	"ProcessAddons",
+	"send_report",
+	"receive_report",
+	"tud_task",
+};
+
+// SysTick counts down, on 24 bits
+static const uint32_t SYSTICK_MASK = 0xffffff;
+
+static StageProfiler stageProfiler;
+
+static const uint32_t STAGE_PROFILE_MAGIC = 0x53544750; // "STGP"
+
+static PersistentStats<StageProfile[STAGE_COUNT], STAGE_PROFILE_MAGIC> __uninitialized_ram(persistentStageProfiles);
+static bool recordingStageProfile = false;
+
+void startStageProfile() {
+	persistentStageProfiles.reset();
+
+	// Free-running on the processor clock, nothing else on core0 uses it
+	systick_hw->csr = 0;
+	systick_hw->rvr = SYSTICK_MASK;
+	systick_hw->cvr = 0;
+	systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+	recordingStageProfile = true;
+}
+
+const StageProfile& getStageProfile(ProfileStage stage) {
+	return persistentStageProfiles.get()[(uint32_t)stage];
+}
+
+const char * getStageName(ProfileStage stage) {
+	return STAGE_NAMES[(uint32_t)stage];
+}
+
+StageProfiler& getStageProfiler() {
+	return stageProfiler;
+}
+
+void StageProfiler::start() {
+	lastTick = systick_hw->cvr;
+}
+
+void StageProfiler::lap(ProfileStage stage) {
+	const uint32_t tick = systick_hw->cvr;
+	const uint32_t cycles = (lastTick - tick) & SYSTICK_MASK;
+	lastTick = tick;
+
+	if (!recordingStageProfile)
+		return;
+
+	persistentStageProfiles.stats[(uint32_t)stage].add(cycles);
+}
+
+#endif
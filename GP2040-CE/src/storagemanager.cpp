@@ -382,6 +382,27 @@ uint8_t * Storage::GetFeatureData()
 	return featureData;
 }
 
+void Storage::PublishProcessedGamepad(const GamepadState& state)
+{
+	ProcessedData data;
+	data.state = state;
+	memcpy(data.featureData, featureData, sizeof(featureData));
+	processedData.publish(data);
+}
+
+void Storage::TakeProcessedGamepad()
+{
+	ProcessedData data;
+	processedData.read(data);
+	processedGamepad->state = data.state;
+	memcpy(processedFeatureData, data.featureData, sizeof(processedFeatureData));
+}
+
+uint8_t * Storage::GetProcessedFeatureData()
+{
+	return processedFeatureData;
+}
+
 /* Animation stuffs */
 AnimationOptions AnimationStorage::getAnimationOptions()
 {
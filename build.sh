@@ -2,17 +2,133 @@
 
 mkdir -p build/
 
-cd gba-link-connection/examples/LinkSPI_demo/
-make rebuild
-cp LinkSPI_demo.mb.gba ../../../build/
+# Push mode: the GBA sends its keys on change instead of being polled (0 or 1)
+export GBA_LINK_PUSH=${GBA_LINK_PUSH:-0}
+# Multi-Play mode: up to 3 GBAs on a Multi-Play link, each its own gamepad (0 or 1)
+export GBA_LINK_MULTI=${GBA_LINK_MULTI:-0}
+# Link ports: 2 for a second GBA on the SPI1 pins, each GBA its own gamepad (1 or 2)
+export GBA_LINK_PORTS=${GBA_LINK_PORTS:-1}
+# 1 kHz polling: the RPi Pico reads the GBA and reports to the host every 1 ms instead of 3 ms (0 or 1)
+export GAMEPAD_POLL_1KHZ=${GAMEPAD_POLL_1KHZ:-0}
+# Core1 acquisition: core1 samples and debounces the GBAs on its own timer, faster than the poll (0 or 1)
+export GAMEPAD_CORE1_INPUT=${GAMEPAD_CORE1_INPUT:-0}
+# Eager debouncing: a key press is reported on the first sample, and only releases are debounced (0 or 1)
+export GAMEPAD_DEBOUNCE_EAGER=${GAMEPAD_DEBOUNCE_EAGER:-1}
+# Stage profiling: the RPi Pico records how long each stage of its gamepad cycle takes, 0 leaves it out (0 or 1)
+export GAMEPAD_STAGE_PROFILE=${GAMEPAD_STAGE_PROFILE:-1}
+# Latency tracing: the RPi Pico times each GBA key edge until the host has its report, 0 leaves it out (0 or 1)
+export GAMEPAD_LATENCY_TRACE=${GAMEPAD_LATENCY_TRACE:-1}
 
-cd ../../../build/
-echo -e "#pragma once\ninline constexpr " > gba_rom.hpp
-xxd -i LinkSPI_demo.mb.gba >> gba_rom.hpp
+# Fingerprint of a GBA program (its sources, link mode and build options), so the RPi Pico doesn't send it again
+# to a GBA that already runs it
+fingerprint() {
+	(cat gba-link-connection/examples/LinkSPI_demo/src/* gba-link-connection/lib/* \
+		GP2040-CE/headers/gba/GBA*.h; echo "$GBA_LINK_PUSH $*") | cksum | cut -d ' ' -f 1
+}
+
+# Little-endian 32-bit word
+le32() {
+	printf "\\x$(printf %02x $(($1 & 0xFF)))\\x$(printf %02x $(($1 >> 8 & 0xFF)))"
+	printf "\\x$(printf %02x $(($1 >> 16 & 0xFF)))\\x$(printf %02x $(($1 >> 24 & 0xFF)))"
+}
+
+# UF2 for the RPi Pico's BOOTSEL drive, 256 bytes per block: bin2uf2 <in> <out> <flash address>
+bin2uf2() {
+	local BLOCKS=$(( ($(wc -c < $1) + 255) / 256 ))
+	for ((i = 0; i < BLOCKS; i++)); do
+		le32 0x0A324655; le32 0x9E5D5157; le32 0x00002000 # magic, family ID present
+		le32 $(($3 + i * 256)); le32 256; le32 $i; le32 $BLOCKS
+		le32 0xE48BFF56 # RP2040
+		{ dd if=$1 bs=256 skip=$i count=1 2>/dev/null; head -c 476 /dev/zero; } | head -c 476
+		le32 0x0AB16F30
+	done > $2
+}
+
+if (( GBA_LINK_MULTI )); then
+	# Multi-Play client: multiboot sends it as is to every GBA on the link, which has no fingerprint query
+	cd gba-link-connection/examples/LinkCable_client/
+	make rebuild
+	cp LinkCable_client.mb.gba ../../../build/
+
+	cd ../../../build/
+	echo -e "#pragma once\ninline constexpr " > gba_rom.hpp
+	xxd -i LinkCable_client.mb.gba >> gba_rom.hpp
+else
+	export GBA_ROM_FINGERPRINT=$(fingerprint)
+
+	cd gba-link-connection/examples/LinkSPI_demo/
+	make rebuild
+	cp LinkSPI_demo.mb.gba ../../../build/
+
+	# Sampling program for the library: same link, no display
+	make rebuild GBA_ROM_HEADLESS=1 GBA_ROM_FINGERPRINT=$(cd ../../../ && fingerprint GBA_ROM_HEADLESS=1)
+	cp LinkSPI_demo.mb.gba ../../../build/LinkSPI_headless.mb.gba
+
+	# Loader stub: multiboot sends it, and it expands the compressed program on the GBA
+	cd ../LinkSPI_loader/
+	make rebuild
+	cp LinkSPI_loader.mb.gba ../../../build/
+
+	cd ../../../build/
+	# BIOS LZ77 format, padded to a whole word
+	# The stub receives at the end of EWRAM and expands from its start, so both must fit in it
+	EWRAM_SIZE=262144
+	for ROM in LinkSPI_demo LinkSPI_headless; do
+		gbalzss e $ROM.mb.gba $ROM.mb.gba.lz
+		../gba-link-connection/examples/LinkSPI_loader/pad16.sh $ROM.mb.gba.lz
+
+		if (( $(wc -c < $ROM.mb.gba) + $(wc -c < $ROM.mb.gba.lz) > EWRAM_SIZE )); then
+			echo "$ROM.mb.gba is too large for the loader stub"
+			exit 1
+		fi
+	done
+
+	echo -e "#pragma once\ninline constexpr " > gba_rom.hpp
+	xxd -i LinkSPI_loader.mb.gba >> gba_rom.hpp
+	echo "inline constexpr " >> gba_rom.hpp
+	xxd -i LinkSPI_demo.mb.gba.lz >> gba_rom.hpp
+	echo "inline constexpr unsigned int LinkSPI_demo_fingerprint = ${GBA_ROM_FINGERPRINT}u;" >> gba_rom.hpp
+
+	# GBA library (see `GP2040-CE/headers/gba/GBALibrary.h`), flashed apart from the firmware.
+	# Entry 0 is the default, the others are picked by holding Select + their D-Pad direction when a program comes up.
+	LIBRARY_ADDRESS=$((0x10100000))
+	LIBRARY_SIZE=$((0x101FE000 - LIBRARY_ADDRESS))
+	LIBRARY_MAX_ENTRIES=16
+	LIB_NAMES=(demo headless)
+	LIB_KEYS=($((0x4 | 0x10)) $((0x4 | 0x20))) # Select + Right, Select + Left
+	LIB_FINGERPRINTS=($GBA_ROM_FINGERPRINT $(cd .. && fingerprint GBA_ROM_HEADLESS=1))
+	LIB_FILES=(LinkSPI_demo.mb.gba.lz LinkSPI_headless.mb.gba.lz)
+
+	{
+		le32 0x4C414247 # "GBAL"
+		le32 ${#LIB_FILES[@]}
+		OFFSET=$((8 + 32 * LIBRARY_MAX_ENTRIES))
+		for i in "${!LIB_FILES[@]}"; do
+			SIZE=$(wc -c < ${LIB_FILES[$i]})
+			{ printf '%s' ${LIB_NAMES[$i]}; head -c 16 /dev/zero; } | head -c 16
+			le32 ${LIB_KEYS[$i]}; le32 ${LIB_FINGERPRINTS[$i]}; le32 $OFFSET; le32 $SIZE
+			OFFSET=$((OFFSET + SIZE))
+		done
+		head -c $((32 * (LIBRARY_MAX_ENTRIES - ${#LIB_FILES[@]}))) /dev/zero
+		cat ${LIB_FILES[@]}
+	} > gba-library.bin
+
+	if (( $(wc -c < gba-library.bin) > LIBRARY_SIZE )); then
+		echo "GBA library is too large for its flash region"
+		exit 1
+	fi
+	bin2uf2 gba-library.bin gba-library.uf2 $LIBRARY_ADDRESS
+fi
 
 cd ../GP2040-CE/
 mkdir -p build/
 cd build/
 cmake ../ -D PICO_SDK_FETCH_FROM_GIT=true
 make -j16
+
+# The firmware must end before the GBA library (Multi-Play builds have none)
+if (( !GBA_LINK_MULTI && $(wc -c < GP2040-CE_0.7.1_Pico.bin) > LIBRARY_ADDRESS - 0x10000000 )); then
+	echo "Firmware overlaps the GBA library"
+	exit 1
+fi
 cp GP2040-CE_0.7.1_Pico.uf2 ../../build/gba-pico-gamepad.uf2
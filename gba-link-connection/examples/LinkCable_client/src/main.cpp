@@ -0,0 +1,55 @@
+#include <tonc.h>
+#include "../../_lib/interrupt.h"
+
+// Multi-Play client for gba-pico-gamepad (`GBA_LINK_MULTI`).
+// The RPi Pico is the parent, and reads our keys from our slot of every transfer.
+#include "../../../../GP2040-CE/headers/gba/GBAKeyFrame.h"
+
+void HBLANK();
+void SERIAL();
+inline void VBLANK() {}
+
+// Backdrop color of each slot, so every player knows which gamepad is theirs
+const u16 PLAYER_COLORS[] = {RGB15(31, 31, 31), RGB15(0, 0, 31),
+                             RGB15(31, 0, 0), RGB15(0, 31, 0)};
+
+volatile u32 keyFrameSeq = 0;
+
+int main() {
+  REG_DISPCNT = DCNT_MODE0;
+
+  // Multi-Play, 115200 bps (same as `LinkCable::BaudRate::BAUD_RATE_3`)
+  REG_RCNT = 0;
+  REG_SIOCNT = SIO_MODE_MULTI | SIO_IRQ | SIO_BAUD_115200;
+  REG_SIOMLT_SEND = gba::sealMultiKeyFrame(0, 0);
+
+  interrupt_init();
+  interrupt_set_handler(INTR_VBLANK, VBLANK);
+  interrupt_enable(INTR_VBLANK);
+  interrupt_set_handler(INTR_HBLANK, HBLANK);
+  interrupt_enable(INTR_HBLANK);
+  interrupt_set_handler(INTR_SERIAL, SERIAL);
+  interrupt_enable(INTR_SERIAL);
+
+  while (true) {
+    u32 playerId = (REG_SIOCNT >> 4) & 3;
+    pal_bg_mem[0] = PLAYER_COLORS[playerId];
+  }
+
+  return 0;
+}
+
+// Keys are sampled every scanline, and go out on the next transfer
+void HBLANK() {
+  // Not while a transfer is going, or the Pico could read a half-written word
+  if (REG_SIOCNT & SIO_START)
+    return;
+
+  u16 keys = ~REG_KEYS & KEY_ANY;
+  REG_SIOMLT_SEND = gba::sealMultiKeyFrame(keys, keyFrameSeq);
+}
+
+// One frame per transfer, so the Pico tells a new one from a repeated one
+void SERIAL() {
+  keyFrameSeq++;
+}
@@ -5,21 +5,40 @@
 // (0) Include the header
 #include "../../../lib/LinkSPI.h"
 
+// Key frame layout, shared with the Pico
+#include "../../../../GP2040-CE/headers/gba/GBAKeyFrame.h"
+
 void log(std::string text);
 void wait(u32 verticalLines);
+void pushKeys();
+void HBLANK();
+void serveLink();
+u32 takeKeyFrame();
+void hardReset();
 inline void VBLANK() {}
 
 // (1) Create a LinkSPI instance
 LinkSPI* linkSPI = new LinkSPI();
 
+// Latest word from the Pico, the frame we sent it, and how many transfers so far
+volatile u32 remoteKeys = 0;
+volatile u32 sentFrame = 0;
+volatile u32 transfers = 0;
+
 void init() {
+#if GBA_ROM_HEADLESS
+  REG_DISPCNT = DCNT_BLANK;
+#else
   REG_DISPCNT = DCNT_MODE0 | DCNT_BG0;
   tte_init_se_default(0, BG_CBB(0) | BG_SBB(31));
+#endif
 
   // (2) Add the interrupt service routines
   interrupt_init();
   interrupt_set_handler(INTR_VBLANK, VBLANK);
   interrupt_enable(INTR_VBLANK);
+  interrupt_set_handler(INTR_HBLANK, HBLANK);
+  interrupt_enable(INTR_HBLANK);
   interrupt_set_handler(INTR_SERIAL, LINK_SPI_ISR_SERIAL);
   interrupt_enable(INTR_SERIAL);
 }
@@ -27,33 +46,171 @@ void init() {
 int main() {
   init();
 
-  bool firstTransfer = true;
+#if GBA_LINK_PUSH
+  pushKeys();
+#endif
 
+  // The transfers themselves run from `HBLANK()` (see `serveLink()`)
   linkSPI->activate(LinkSPI::Mode::SLAVE);
+  log("[gba-pico-gamepad]\n\nWaiting...");
+
+  u32 shownTransfers = 0;
 
   while (true) {
-    std::string output = "[gba-pico-gamepad]\n\n";
-    u16 keys = ~REG_KEYS & KEY_ANY;
+    // The Pico asks which program we are before skipping the upload (see `GBAKeyFrame.h`)
+    if (remoteKeys == gba::GBA_QUERY_RESET)
+      hardReset();
 
-    if (firstTransfer) {
-      log(output + "Waiting...");
-      firstTransfer = false;
-    }
+#if !GBA_ROM_HEADLESS
+    if (transfers == shownTransfers)
+      continue;
+    shownTransfers = transfers;
 
-    // Exchange 32-bit data with the other end
-    u32 remoteKeys = linkSPI->transfer(keys);
-    output += "send: " + std::to_string(keys) + "\n";
+    std::string output = "[gba-pico-gamepad]\n\n";
+    output += "send: " + std::to_string(sentFrame) + "\n";
     output += "recv: " + std::to_string(remoteKeys) + "\n";
 
     // Print
     // VBlankIntrWait();
     log(output);
+#endif
   }
 
   return 0;
 }
 
+// Key history
+// Keys are sampled every scanline, so a tap shorter than the Pico's poll interval
+// still shows up in the next frame as a pair of edges (see `GBAKeyFrame.h`).
+
+struct KeyEdge {
+  u32 keyBit;
+  u32 line;
+};
+
+volatile u16 sampledKeys = 0;
+volatile u32 lineCount = 0;
+KeyEdge keyEdges[gba::GBA_FRAME_EDGE_COUNT];  // newest first
+volatile u32 keyEdgeCount = 0;
+u32 keyFrameSeq = 0;
+
+// Slave link: we only arm a transfer when the Pico asks for one, by pulling our SI low (see `gba_sio.pio`),
+// so the frame it clocks holds the keys, and the edge ages, of the scanline it asked on.
+// A Pico that clocks without asking (the multiboot side, looking for a running program) still finds us
+// armed once it hasn't asked for this many scanlines, longer than any stream interval.
+constexpr u32 LINK_IDLE_ARM_LINES = 64;
+
+u32 linkIdleLines = 0;
+
+void HBLANK() {
+  u16 keys = ~REG_KEYS & KEY_ANY;
+  u16 changed = keys ^ sampledKeys;
+
+  lineCount++;
+  sampledKeys = keys;
+
+  for (u32 bit = 0; changed != 0; bit++, changed >>= 1) {
+    if (!(changed & 1))
+      continue;
+
+    for (u32 i = gba::GBA_FRAME_EDGE_COUNT - 1; i > 0; i--)
+      keyEdges[i] = keyEdges[i - 1];
+    keyEdges[0] = {bit, lineCount};
+    if (keyEdgeCount < gba::GBA_FRAME_EDGE_COUNT)
+      keyEdgeCount++;
+  }
+
+  serveLink();
+}
+
+void serveLink() {
+  if (!linkSPI->isActive() || linkSPI->getMode() != LinkSPI::Mode::SLAVE)
+    return;
+
+  switch (linkSPI->getAsyncState()) {
+    case LinkSPI::AsyncState::WAITING:
+      // Armed: the frame can't change until the Pico has clocked it
+      return;
+    case LinkSPI::AsyncState::READY:
+      remoteKeys = linkSPI->getAsyncData();
+      transfers++;
+      linkIdleLines = 0;
+      break;
+    case LinkSPI::AsyncState::IDLE:
+      break;
+  }
+
+  bool requested = !linkSPI->_isSIHigh();
+  if (!requested && ++linkIdleLines < LINK_IDLE_ARM_LINES)
+    return;
+  linkIdleLines = 0;
+
+  u32 frame = remoteKeys == gba::GBA_QUERY_FINGERPRINT ? GBA_ROM_FINGERPRINT
+                                                        : takeKeyFrame();
+  sentFrame = frame;
+  linkSPI->transferAsync(frame);
+}
+
+u32 takeKeyFrame() {
+  // Also called from `HBLANK()`, which must not get interrupts back on
+  u16 ime = REG_IME;
+  REG_IME = 0;
+
+  u32 frame = sampledKeys;
+  for (u32 i = 0; i < keyEdgeCount; i++) {
+    u32 ticks = (lineCount - keyEdges[i].line) / gba::GBA_FRAME_TICK_LINES;
+    frame |= gba::packKeyEdge(keyEdges[i].keyBit, ticks)
+             << (gba::GBA_FRAME_EDGE_SHIFT + i * gba::GBA_FRAME_EDGE_BITS);
+  }
+  keyEdgeCount = 0;
+
+  REG_IME = ime;
+  return gba::sealKeyFrame(frame, keyFrameSeq++);
+}
+
+// Back to the BIOS boot sequence, which waits for a multiboot program again
+void hardReset() {
+  REG_IME = 0;
+  asm volatile("swi 0x26");
+}
+
+#if GBA_LINK_PUSH
+// Push mode: we're the master, and send our keys as soon as they change.
+// The Pico holds SI low while it listens, so wait mode only blocks until it's up.
+// Unchanged keys are re-sent every frame, so the Pico can tell we're still here.
+void pushKeys() {
+  constexpr u32 KEEPALIVE_LINES = 228;
+
+  linkSPI->activate(LinkSPI::Mode::MASTER_2MBPS);
+  linkSPI->setWaitModeActive(true);
+
+  u16 lastKeys = KEY_ANY + 1;  // never a real key state, so the first frame goes out right away
+  u32 lastLine = lineCount;
+
+  log("[gba-pico-gamepad]\n\nWaiting...");
+
+  while (true) {
+    u16 keys = sampledKeys;
+
+    if (keys == lastKeys && lineCount - lastLine < KEEPALIVE_LINES)
+      continue;
+
+    linkSPI->transfer(takeKeyFrame());
+    lastLine = lineCount;
+
+    if (keys != lastKeys) {
+      lastKeys = keys;
+      if (!GBA_ROM_HEADLESS)
+        log("[gba-pico-gamepad]\n\npush: " + std::to_string(keys) + "\n");
+    }
+  }
+}
+#endif
+
 void log(std::string text) {
+  if (GBA_ROM_HEADLESS)
+    return;
+
   tte_erase_screen();
   tte_write("#{P:0,0}");
   tte_write(text.c_str());
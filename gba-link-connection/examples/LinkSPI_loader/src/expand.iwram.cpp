@@ -0,0 +1,16 @@
+#include <tonc.h>
+
+#include "../../../../GP2040-CE/headers/gba/GBALoader.h"
+
+// Runs from IWRAM, since the BIOS expands the program over this stub's EWRAM.
+// The BIOS call is made inline for the same reason, as `LZ77UnCompWram()` lives in EWRAM.
+IWRAM_CODE void expand(const void* src) {
+  asm volatile(
+      "mov r0, %0\n"
+      "mov r1, %1\n"
+      "swi 0x110000\n"  // LZ77UnCompReadNormalWrite8bit
+      "bx %2\n"
+      :
+      : "r"(src), "r"(gba::GBA_LOADER_EWRAM), "r"(gba::GBA_LOADER_ENTRY)
+      : "r0", "r1", "r2", "r3", "memory");
+}
@@ -0,0 +1,34 @@
+#include <tonc.h>
+
+// Loader stub for gba-pico-gamepad.
+// The RPi Pico sends this via multiboot, and then the LZ77-compressed program to it.
+#include "../../../../GP2040-CE/headers/gba/GBALoader.h"
+
+IWRAM_CODE void expand(const void* src);
+
+u32 exchange(u32 reply) {
+  REG_SIODATA32 = reply;
+  REG_SIOCNT |= SION_ENABLE;
+  while (REG_SIOCNT & SION_ENABLE)
+    ;
+
+  return REG_SIODATA32;
+}
+
+int main() {
+  REG_IME = 0;
+
+  // Normal mode, 32-bit, external clock (same as `LinkSPI` slave)
+  REG_RCNT = 0;
+  REG_SIOCNT = SIO_MODE_32BIT | SION_CLK_EXT;
+
+  // Receive at the end of EWRAM, away from both this stub and the expanded program
+  u32 count = exchange(gba::GBA_LOADER_MAGIC);
+  u32* buffer = (u32*)(gba::GBA_LOADER_EWRAM_END - count * 4);
+
+  for (u32 i = 0; i < count; i++)
+    buffer[i] = exchange(gba::GBA_LOADER_MAGIC | ((i + 1) & 0xFFFF));
+
+  expand(buffer);
+  return 0;
+}